@@ -33,11 +33,17 @@
 #include "las_ctx.h"
 #include "las_ops.h"
 #include "las_record.h"
+#include "las_key.h"
+#include "las_batch.h"
+#include "las_scan.h"
 
 LUALIB_API int luaopen_aerospike( lua_State *L )
 {
     // context
     las_ctx_init( L );
+    // scan iterator
+    las_scaniter_init( L );
+    las_scanjob_init( L );
     
     // add methods
     lua_newtable( L );
@@ -50,19 +56,35 @@ LUALIB_API int luaopen_aerospike( lua_State *L )
     // UDF
     luaopen_aerospike_udf( L );
     lua_setfield( L, -2, "udf" );
+    // prepared key
+    luaopen_aerospike_key( L );
+    lua_setfield( L, -2, "key" );
     // record
-    //luaopen_aerospike_record( L );
-    //lua_setfield( L, -2, "record" );
+    luaopen_aerospike_record( L );
+    lua_setfield( L, -2, "record" );
+    // prepared batch
+    luaopen_aerospike_batch( L );
+    lua_setfield( L, -2, "batch" );
     
     // constants
     // types for create index
     lstate_num2tbl( L, "IDX_INTEGER", LAS_IDX_INTEGER );
     lstate_num2tbl( L, "IDX_STRING", LAS_IDX_STRING );
+    // types of primary key
+    lstate_num2tbl( L, "KEY_STRING", LAS_KEY_STRING );
+    lstate_num2tbl( L, "KEY_INTEGER", LAS_KEY_INTEGER );
+    lstate_num2tbl( L, "KEY_BYTES", LAS_KEY_BYTES );
+    lstate_num2tbl( L, "KEY_DIGEST", LAS_KEY_DIGEST );
     // scan priorities
     lstate_num2tbl( L, "SCAN_PRIORITY_AUTO", AS_SCAN_PRIORITY_AUTO );
     lstate_num2tbl( L, "SCAN_PRIORITY_LOW", AS_SCAN_PRIORITY_LOW );
     lstate_num2tbl( L, "SCAN_PRIORITY_MEDIUM", AS_SCAN_PRIORITY_MEDIUM );
     lstate_num2tbl( L, "SCAN_PRIORITY_HIGH", AS_SCAN_PRIORITY_HIGH );
+    // scan job status
+    lstate_num2tbl( L, "SCAN_STATUS_UNDEF", AS_SCAN_STATUS_UNDEF );
+    lstate_num2tbl( L, "SCAN_STATUS_INPROGRESS", AS_SCAN_STATUS_INPROGRESS );
+    lstate_num2tbl( L, "SCAN_STATUS_ABORTED", AS_SCAN_STATUS_ABORTED );
+    lstate_num2tbl( L, "SCAN_STATUS_COMPLETED", AS_SCAN_STATUS_COMPLETED );
     
     return 1;
 }
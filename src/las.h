@@ -45,6 +45,10 @@
 #define LAS_CONTEXT_MT      "aerospike.context"
 #define LAS_OPERATION_MT    "aerospike.operation"
 #define LAS_RECORD_MT       "aerospike.record"
+#define LAS_KEY_MT          "aerospike.key"
+#define LAS_BATCH_MT        "aerospike.batch"
+#define LAS_SCANITER_MT     "aerospike.scaniter"
+#define LAS_SCANJOB_MT      "aerospike.scanjob"
 
 // common metamethods
 #define TOSTRING_MT(L,tname) ({ \
@@ -0,0 +1,1514 @@
+/*
+ *  Copyright 2014 Masatoshi Teruya. All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  las_batch.c
+ *  lua-aerospike
+ *
+ *  Created by Masatoshi Teruya on 2014/09/17.
+ *
+ */
+
+#include "las_batch.h"
+#include "las_key.h"
+#include "las_worker.h"
+#include "bitvec.h"
+
+
+// MARK: batch operations
+void las_batch_init( lua_State *L, las_batch_t *lbatch, aerospike *as,
+                     las_ctx_t *ctx, int op )
+{
+    lbatch->as = as;
+    lbatch->ctx = ctx;
+    lbatch->L = L;
+    lbatch->op = op;
+    lbatch->ordered = ctx->opt.ordered;
+    lbatch->policy = &ctx->policies.batch;
+    lbatch->bins = NULL;
+    lbatch->nbins = 0;
+    lbatch->into = 0;
+    lbatch->pool = 0;
+    lbatch->npool = 0;
+    lbatch->fn = 0;
+    lbatch->status = 0;
+    lbatch->pos.nkeys = 0;
+    lbatch->pos.upos = NULL;
+    lbatch->pos.ufirst = NULL;
+}
+
+
+// MARK: key deduplication
+// keys of a batch belong to the same namespace, so the digest identifies them
+#define las_batch_keyeq( a, b ) \
+    ( memcmp( (a)->digest.value, (b)->digest.value, \
+              AS_DIGEST_VALUE_SIZE ) == 0 )
+
+
+// the digest is already well distributed, use its first bytes as the hash
+static inline uint32_t las_batch_keyhash( const as_key *key )
+{
+    const uint8_t *v = key->digest.value;
+    
+    return (uint32_t)v[0] | (uint32_t)v[1] << 8 | (uint32_t)v[2] << 16 |
+           (uint32_t)v[3] << 24;
+}
+
+
+// copy the key and its value that refers to the key itself
+#define las_batch_keycpy( dst, src ) do { \
+    memcpy( (dst), (src), sizeof( as_key ) ); \
+    if( (src)->valuep == &(src)->value ){ \
+        (dst)->valuep = &(dst)->value; \
+    } \
+}while(0)
+
+
+// remove the duplicated keys by digest and keep the rest in order of their
+// first positions. pos maps the original positions to the unique keys, and
+// is allocated only when a duplicated key is found.
+static int las_batch_dedup( as_batch *batch, las_batch_pos_t *pos )
+{
+    const uint32_t nkeys = batch->keys.size;
+    as_key *keys = batch->keys.entries;
+    // open addressing table of the unique key index + 1
+    uint32_t *slots = NULL;
+    uint32_t mask = 1;
+    uint32_t nuniq = 0;
+    uint32_t i = 0;
+    uint32_t h = 0;
+    
+    pos->nkeys = nkeys;
+    pos->upos = pos->ufirst = NULL;
+    if( nkeys < 2 ){
+        return 0;
+    }
+    // keep the load factor under 0.5
+    while( mask < nkeys * 2 ){
+        mask <<= 1;
+    }
+    if( !( slots = pcalloc( mask, uint32_t ) ) ){
+        return -1;
+    }
+    mask--;
+    
+    for(; i < nkeys; i++ )
+    {
+        as_key_digest( &keys[i] );
+        h = las_batch_keyhash( &keys[i] ) & mask;
+        while( slots[h] && !las_batch_keyeq( &keys[slots[h] - 1], &keys[i] ) ){
+            h = ( h + 1 ) & mask;
+        }
+        
+        // duplicated key
+        if( slots[h] )
+        {
+            // all keys before this position are unique
+            if( !pos->upos )
+            {
+                if( !( pos->upos = pnalloc( nkeys * 2, uint32_t ) ) ){
+                    pdealloc( slots );
+                    return -1;
+                }
+                pos->ufirst = pos->upos + nkeys;
+                for( nuniq = 0; nuniq < i; nuniq++ ){
+                    pos->upos[nuniq] = pos->ufirst[nuniq] = nuniq;
+                }
+            }
+            as_key_destroy( &keys[i] );
+            pos->upos[i] = slots[h] - 1;
+            continue;
+        }
+        
+        if( pos->upos ){
+            las_batch_keycpy( &keys[nuniq], &keys[i] );
+            pos->upos[i] = nuniq;
+            pos->ufirst[nuniq] = i;
+        }
+        slots[h] = ++nuniq;
+    }
+    batch->keys.size = nuniq;
+    pdealloc( slots );
+    
+    return 0;
+}
+
+
+// keys: kidx...kidx+nkeys-1 or kidx = { key, ... }.
+// nkeys is ignored if the value at kidx is an array of keys.
+int las_batch_setkeys( lua_State *L, las_batch_t *lbatch, int kidx,
+                       int nkeys )
+{
+    las_ctx_t *ctx = lbatch->ctx;
+    // array of keys
+    int karr = lua_istable( L, kidx );
+    uint32_t idx = 0;
+    int pidx = 0;
+    as_key *key = NULL;
+    const char *errstr = NULL;
+    
+    if( karr ){
+        nkeys = (int)lua_objlen( L, kidx );
+    }
+    
+    if( !as_batch_init( &lbatch->batch, (uint32_t)nkeys ) ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    // set keys
+    for(; idx < (uint32_t)nkeys; idx++ )
+    {
+        if( karr ){
+            lua_rawgeti( L, kidx, (int)idx + 1 );
+            pidx = lua_gettop( L );
+        }
+        else {
+            pidx = kidx + (int)idx;
+        }
+        
+        key = las_pk_init( L, pidx, ctx->ns, ctx->set,
+                           as_batch_keyat( &lbatch->batch, idx ) );
+        if( !key ){
+            errstr = las_pk_strerror( L, pidx );
+            // number of initialized keys
+            lbatch->batch.keys.size = idx;
+            as_batch_destroy( &lbatch->batch );
+            lua_pushnil( L );
+            lua_pushfstring( L, "key#%d %s", (int)idx + 1, errstr );
+            return 2;
+        }
+        else if( karr ){
+            // pk string is held by the array
+            lua_pop( L, 1 );
+        }
+    }
+    
+    if( las_batch_dedup( &lbatch->batch, &lbatch->pos ) != 0 ){
+        as_batch_destroy( &lbatch->batch );
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    return 0;
+}
+
+
+// returns true if the table at the top of stack is in the pool
+static inline int las_batch_pooled( lua_State *L, las_batch_t *lbatch )
+{
+    int rv = 0;
+    
+    lua_pushvalue( L, -1 );
+    lua_rawget( L, lbatch->pool );
+    rv = !lua_isnil( L, -1 );
+    lua_pop( L, 1 );
+    
+    return rv;
+}
+
+
+// maximum number of record tables in the pool
+#define las_batch_poolmax( ctx ) \
+    ( (ctx)->opt.chunk ? (int)(ctx)->opt.chunk : LAS_BATCH_CHUNK )
+
+
+// clear the bins of the record table at the top of stack, so that the pool
+// does not hold the values of the previous results
+static inline void las_batch_clearbins( lua_State *L )
+{
+    lua_pushliteral( L, "bins" );
+    lua_rawget( L, -2 );
+    if( lua_istable( L, -1 ) ){
+        lstate_tblclear( L, -1 );
+    }
+    lua_pop( L, 1 );
+}
+
+
+// clear the result table at into and move its record tables to the pool
+void las_batch_setinto( lua_State *L, las_batch_t *lbatch, int into )
+{
+    if( ( lbatch->into = into ) )
+    {
+        const int poolmax = las_batch_poolmax( lbatch->ctx );
+        
+        lstate_pushref( L, lbatch->ctx->ref_pool );
+        lbatch->pool = lua_gettop( L );
+        lbatch->npool = (int)lua_objlen( L, lbatch->pool );
+        lua_pushnil( L );
+        while( lua_next( L, into ) )
+        {
+            // record table of the duplicated keys is pooled once, and the
+            // tables over the limit are left to the gc
+            if( lua_istable( L, -1 ) && lbatch->npool < poolmax &&
+                !las_batch_pooled( L, lbatch ) ){
+                las_batch_clearbins( L );
+                lua_pushvalue( L, -1 );
+                lua_pushboolean( L, 1 );
+                lua_rawset( L, lbatch->pool );
+                lua_rawseti( L, lbatch->pool, ++lbatch->npool );
+            }
+            else {
+                lua_pop( L, 1 );
+            }
+            lua_pushvalue( L, -1 );
+            lua_pushnil( L );
+            lua_rawset( L, into );
+        }
+    }
+}
+
+
+// number of bin names of the array at idx
+int las_batch_checkbins( lua_State *L, int idx, size_t *nbins )
+{
+    *nbins = lua_istable( L, idx ) ? lua_objlen( L, idx ) : 0;
+    
+    if( !*nbins ){
+        return luaL_argerror( L, idx, "bins must be array of bin names" );
+    }
+    else if( *nbins > UINT16_MAX ){
+        lua_pushnil( L );
+        lua_pushliteral( L, LAS_ERR_BIN_LIMIT );
+        return 2;
+    }
+    
+    return 0;
+}
+
+
+// bin names: idx = { bin, ... }, bins must be able to hold nbins + 1 names
+int las_batch_setbins( lua_State *L, las_batch_t *lbatch, int idx,
+                       const char *bins[], size_t nbins )
+{
+    size_t i = 1;
+    
+    for(; i <= nbins; i++ )
+    {
+        lua_rawgeti( L, idx, (int)i );
+        bins[i-1] = LAS_CHK_BINNAME( L, -1 );
+        lua_pop( L, 1 );
+        if( !bins[i-1] ){
+            lua_pushnil( L );
+            lua_pushliteral( L, LAS_ERR_BIN_NAME );
+            return 2;
+        }
+    }
+    bins[nbins] = NULL;
+    lbatch->bins = bins;
+    lbatch->nbins = (uint32_t)nbins;
+    
+    return 0;
+}
+
+
+
+// replace the record table at the top of stack with the error message of
+// the bins that could not be decoded
+#define las_batch_pushdecerr( L ) do { \
+    lua_pop( L, 1 ); \
+    lua_pushliteral( L, LAS_ERR_BIN_DECODE ); \
+}while(0)
+
+
+// push a record table that taken from the pool or a new table
+static inline void las_batch_pushrec( lua_State *L, las_batch_t *lbatch )
+{
+    if( lbatch->npool ){
+        lua_rawgeti( L, lbatch->pool, lbatch->npool );
+        lua_pushnil( L );
+        lua_rawseti( L, lbatch->pool, lbatch->npool-- );
+        lua_pushvalue( L, -1 );
+        lua_pushnil( L );
+        lua_rawset( L, lbatch->pool );
+    }
+    else {
+        lua_createtable( L, 0, 3 );
+    }
+}
+
+
+static bool batchget_cb( const as_batch_read *results, uint32_t n, void *udata )
+{
+    las_batch_t *lbatch = (las_batch_t*)udata;
+    lua_State *L = lbatch->L;
+    uint32_t i = 0;
+    as_error err;
+    
+    lstate_pushinto( L, lbatch->into, 0, n );
+    for(; i < n; i++ )
+    {
+        switch( results[i].result )
+        {
+            case AEROSPIKE_OK:
+                las_pk_push( L, results[i].key );
+                if( lbatch->op == LAS_BATCH_EXISTS ){
+                    lua_pushboolean( L, 1 );
+                }
+                else
+                {
+                    las_batch_pushrec( L, lbatch );
+                    if( lstate_asrec2result( L,
+                                             (as_record*)&results[i].record ) != 0 ){
+                        las_batch_pushdecerr( L );
+                    }
+                }
+                lua_rawset( L, -3 );
+            break;
+            case AEROSPIKE_ERR_RECORD_NOT_FOUND:
+                if( lbatch->op == LAS_BATCH_EXISTS ){
+                    las_pk_push( L, results[i].key );
+                    lua_pushboolean( L, 0 );
+                    lua_rawset( L, -3 );
+                }
+            break;
+            
+            // The transaction didn't succeed.
+            default:
+                as_error_init( &err );
+                LAS_SET_ASERROR( &err, results[i].result );
+                las_pk_push( L, results[i].key );
+                lua_pushstring( L, err.message );
+                lua_rawset( L, -3 );
+        }
+    }
+    
+    return true;
+}
+
+
+// results are in order of keys
+static bool batchget_arr_cb( const as_batch_read *results, uint32_t n,
+                             void *udata )
+{
+    las_batch_t *lbatch = (las_batch_t*)udata;
+    lua_State *L = lbatch->L;
+    const las_batch_pos_t *pos = &lbatch->pos;
+    uint32_t j = 0;
+    uint32_t i = 0;
+    as_error err;
+    
+    lstate_pushinto( L, lbatch->into, pos->nkeys, 0 );
+    for(; j < pos->nkeys; j++ )
+    {
+        i = las_batch_upos( pos, j );
+        // duplicated key refers to the result at the first position
+        if( las_batch_ufirst( pos, i ) != j ){
+            lua_rawgeti( L, -1, (int)las_batch_ufirst( pos, i ) + 1 );
+            lua_rawseti( L, -2, (int)j + 1 );
+            continue;
+        }
+        
+        switch( i < n ? results[i].result : AEROSPIKE_ERR_RECORD_NOT_FOUND )
+        {
+            case AEROSPIKE_OK:
+                if( lbatch->op == LAS_BATCH_EXISTS ){
+                    lua_pushboolean( L, 1 );
+                }
+                else
+                {
+                    las_batch_pushrec( L, lbatch );
+                    if( lstate_asrec2result( L,
+                                             (as_record*)&results[i].record ) != 0 ){
+                        las_batch_pushdecerr( L );
+                    }
+                }
+            break;
+            case AEROSPIKE_ERR_RECORD_NOT_FOUND:
+                lua_pushboolean( L, 0 );
+            break;
+            
+            // The transaction didn't succeed.
+            default:
+                as_error_init( &err );
+                LAS_SET_ASERROR( &err, results[i].result );
+                lua_pushstring( L, err.message );
+        }
+        lua_rawseti( L, -2, (int)j + 1 );
+    }
+    
+    return true;
+}
+
+#define las_batch_cb( lbatch ) \
+    ((lbatch)->ordered ? batchget_arr_cb : batchget_cb)
+
+
+static as_status las_batch_request( las_batch_t *lbatch, as_batch *batch,
+                                    as_error *err,
+                                    aerospike_batch_read_callback cb,
+                                    void *udata )
+{
+    switch( lbatch->op ){
+        case LAS_BATCH_EXISTS:
+            return aerospike_batch_exists( lbatch->as, err, lbatch->policy,
+                                           batch, cb, udata );
+        case LAS_BATCH_SELECT:
+            return aerospike_batch_select( lbatch->as, err, lbatch->policy,
+                                           batch, lbatch->bins, lbatch->nbins,
+                                           cb, udata );
+        default:
+            return aerospike_batch_get( lbatch->as, err, lbatch->policy,
+                                        batch, cb, udata );
+    }
+}
+
+
+// MARK: chunked batch operations
+// result of the key that read by the worker thread
+typedef struct {
+    as_status result;
+    uint16_t gen;
+    uint32_t ttl;
+    // encoded bins in the chunk buffer
+    size_t off;
+    size_t len;
+} las_batch_res_t;
+
+typedef struct {
+    las_batch_t *lbatch;
+    // keys of the chunk that refer to lbatch->batch
+    as_batch batch;
+    las_batch_res_t *res;
+    las_mpack_t mp;
+    as_status rc;
+    as_error err;
+} las_batch_chunk_t;
+
+
+// init the batch that refers to size keys of lbatch->batch from offset
+static inline void las_batch_chunkat( las_batch_t *lbatch, as_batch *batch,
+                                      uint32_t offset, uint32_t size )
+{
+    const uint32_t nkeys = lbatch->batch.keys.size - offset;
+    
+    batch->_free = false;
+    batch->keys._free = false;
+    batch->keys.entries = as_batch_keyat( &lbatch->batch, offset );
+    batch->keys.size = nkeys < size ? nkeys : size;
+    batch->keys.capacity = batch->keys.size;
+}
+
+
+// called by the worker thread
+static bool batchchunk_cb( const as_batch_read *results, uint32_t n,
+                           void *udata )
+{
+    las_batch_chunk_t *chunk = (las_batch_chunk_t*)udata;
+    const as_key *keys = chunk->batch.keys.entries;
+    const uint32_t nkeys = chunk->batch.keys.size;
+    las_batch_res_t *res = NULL;
+    uint32_t i = 0;
+    
+    for(; i < n; i++ )
+    {
+        // results refer to the keys of the chunk
+        if( results[i].key >= keys && results[i].key < keys + nkeys ){
+            res = &chunk->res[results[i].key - keys];
+        }
+        else {
+            res = &chunk->res[i];
+        }
+        
+        res->result = results[i].result;
+        if( res->result == AEROSPIKE_OK &&
+            chunk->lbatch->op != LAS_BATCH_EXISTS )
+        {
+            res->gen = results[i].record.gen;
+            res->ttl = results[i].record.ttl;
+            res->off = chunk->mp.len;
+            if( las_mpack_asrec( &chunk->mp, &results[i].record ) != 0 ){
+                res->result = AEROSPIKE_ERR_CLIENT;
+            }
+            res->len = chunk->mp.len - res->off;
+        }
+    }
+    
+    return true;
+}
+
+
+static void batchchunk_run( uint32_t idx, uint32_t slot, void *udata )
+{
+    las_batch_chunk_t *chunk = &((las_batch_chunk_t*)udata)[idx];
+    
+    (void)slot;
+    chunk->rc = las_batch_request( chunk->lbatch, &chunk->batch, &chunk->err,
+                                   batchchunk_cb, (void*)chunk );
+}
+
+
+// set ttl, gen and the encoded bins into the table at the top of stack.
+// returns -1 if the bins could not be decoded.
+static int las_batch_res2tbl( lua_State *L, las_batch_res_t *res,
+                              const uint8_t *data )
+{
+    const int top = lua_gettop( L );
+    
+    lstate_num2tbl( L, "ttl", res->ttl );
+    lstate_num2tbl( L, "gen", res->gen );
+    lua_pushliteral( L, "bins" );
+    lua_pushvalue( L, -1 );
+    lua_rawget( L, -3 );
+    if( lua_istable( L, -1 ) ){
+        lstate_tblclear( L, -1 );
+    }
+    else {
+        lua_pop( L, 1 );
+        lua_newtable( L );
+    }
+    if( las_mpack_raw2tblat( L, data + res->off, res->len ) != 0 ){
+        lua_settop( L, top );
+        return -1;
+    }
+    lua_rawset( L, -3 );
+    
+    return 0;
+}
+
+
+static void las_batch_pushchunks( lua_State *L, las_batch_t *lbatch,
+                                  las_batch_chunk_t *chunks, uint32_t size )
+{
+    const las_batch_pos_t *pos = &lbatch->pos;
+    // number of positions of the ordered results or the unique keys
+    const uint32_t nkeys = lbatch->ordered ? pos->nkeys :
+                                             lbatch->batch.keys.size;
+    las_batch_chunk_t *chunk = NULL;
+    las_batch_res_t *res = NULL;
+    uint32_t j = 0;
+    uint32_t i = 0;
+    as_error err;
+    
+    if( lbatch->ordered ){
+        lstate_pushinto( L, lbatch->into, nkeys, 0 );
+    }
+    else {
+        lstate_pushinto( L, lbatch->into, 0, nkeys );
+    }
+    
+    for(; j < nkeys; j++ )
+    {
+        i = j;
+        if( lbatch->ordered )
+        {
+            i = las_batch_upos( pos, j );
+            // duplicated key refers to the result at the first position
+            if( las_batch_ufirst( pos, i ) != j ){
+                lua_rawgeti( L, -1, (int)las_batch_ufirst( pos, i ) + 1 );
+                lua_rawseti( L, -2, (int)j + 1 );
+                continue;
+            }
+        }
+        chunk = &chunks[i / size];
+        res = &chunk->res[i % size];
+        if( !lbatch->ordered ){
+            las_pk_push( L, as_batch_keyat( &lbatch->batch, i ) );
+        }
+        
+        switch( res->result )
+        {
+            case AEROSPIKE_OK:
+                if( lbatch->op == LAS_BATCH_EXISTS ){
+                    lua_pushboolean( L, 1 );
+                }
+                else
+                {
+                    las_batch_pushrec( L, lbatch );
+                    // got malformed data
+                    if( las_batch_res2tbl( L, res, chunk->mp.data ) != 0 ){
+                        las_batch_pushdecerr( L );
+                    }
+                }
+            break;
+            case AEROSPIKE_ERR_RECORD_NOT_FOUND:
+                if( lbatch->ordered || lbatch->op == LAS_BATCH_EXISTS ){
+                    lua_pushboolean( L, 0 );
+                }
+                // ignore
+                else {
+                    lua_pop( L, 1 );
+                    continue;
+                }
+            break;
+            
+            // The transaction didn't succeed.
+            default:
+                as_error_init( &err );
+                LAS_SET_ASERROR( &err, res->result );
+                lua_pushstring( L, err.message );
+        }
+        
+        if( lbatch->ordered ){
+            lua_rawseti( L, -2, (int)j + 1 );
+        }
+        else {
+            lua_rawset( L, -3 );
+        }
+    }
+}
+
+
+// push the bitmap string that bit i is set if the key at position i exists.
+// bit i is the (i % 8)th bit from LSB of the (i / 8)th byte.
+static int las_batch_pushbits( lua_State *L, las_batch_t *lbatch,
+                               las_batch_chunk_t *chunks, uint32_t size )
+{
+    const las_batch_pos_t *pos = &lbatch->pos;
+    las_batch_res_t *res = NULL;
+    size_t len = ( pos->nkeys + 7 ) / 8;
+    uint32_t j = 0;
+    uint32_t i = 0;
+    luaL_Buffer b;
+    bitvec_t bv;
+    as_error err;
+    
+    if( bitvec_alloc( &bv, pos->nkeys ) != 0 ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    for(; j < pos->nkeys; j++ )
+    {
+        i = las_batch_upos( pos, j );
+        res = &chunks[i / size].res[i % size];
+        switch( res->result ){
+            case AEROSPIKE_OK:
+                bitvec_set( &bv, j );
+            break;
+            case AEROSPIKE_ERR_RECORD_NOT_FOUND:
+            break;
+            
+            // The transaction didn't succeed.
+            default:
+                bitvec_dealloc( &bv );
+                as_error_init( &err );
+                LAS_SET_ASERROR( &err, res->result );
+                lua_pushnil( L );
+                lua_pushstring( L, err.message );
+                return 2;
+        }
+    }
+    
+    // bytes of the vectors in little endian order
+    luaL_buffinit( L, &b );
+    for( i = 0; i < len; i++ ){
+        luaL_addchar( &b, (char)( bv.vec[i / BV_BYTE] >> ( i % BV_BYTE * 8 ) ) );
+    }
+    luaL_pushresult( &b );
+    bitvec_dealloc( &bv );
+    
+    return 1;
+}
+
+
+// split keys into chunks and dispatch them to the worker threads
+static int las_batch_run_chunks( lua_State *L, las_batch_t *lbatch,
+                                 const uint32_t size )
+{
+    const uint32_t nkeys = lbatch->batch.keys.size;
+    const uint32_t nchunk = ( nkeys + size - 1 ) / size;
+    las_batch_chunk_t *chunks = calloc( nchunk, sizeof( las_batch_chunk_t ) );
+    las_batch_res_t *res = calloc( nkeys, sizeof( las_batch_res_t ) );
+    las_batch_chunk_t *chunk = NULL;
+    uint32_t i = 0;
+    int rv = 1;
+    
+    if( !chunks || !res ){
+        free( chunks );
+        free( res );
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    for(; i < nchunk; i++ )
+    {
+        chunk = &chunks[i];
+        chunk->lbatch = lbatch;
+        las_batch_chunkat( lbatch, &chunk->batch, i * size, size );
+        chunk->res = res + i * size;
+        las_mpack_init( &chunk->mp );
+    }
+    
+    las_worker_run( nchunk, lbatch->ctx->opt.concurrency, batchchunk_run,
+                    (void*)chunks );
+    
+    // check errors of the requests
+    for( i = 0; i < nchunk; i++ )
+    {
+        if( chunks[i].rc != AEROSPIKE_OK ){
+            lua_pushnil( L );
+            lua_pushstring( L, chunks[i].err.message );
+            rv = 2;
+            break;
+        }
+    }
+    if( rv == 1 )
+    {
+        if( lbatch->op == LAS_BATCH_EXISTS && lbatch->ctx->opt.bitmap ){
+            rv = las_batch_pushbits( L, lbatch, chunks, size );
+        }
+        else {
+            las_batch_pushchunks( L, lbatch, chunks, size );
+        }
+    }
+    
+    for( i = 0; i < nchunk; i++ ){
+        las_mpack_dispose( &chunks[i].mp );
+    }
+    free( chunks );
+    free( res );
+    
+    return rv;
+}
+
+
+// run the batch operation. keys will be released by its owner
+int las_batch_run( lua_State *L, las_batch_t *lbatch )
+{
+    const uint32_t nkeys = lbatch->batch.keys.size;
+    const uint32_t chunk = lbatch->ctx->opt.chunk;
+    as_error err;
+    int rv = 1;
+    
+    // bitmap is built from the results that collected by the chunks
+    if( lbatch->op == LAS_BATCH_EXISTS && lbatch->ctx->opt.bitmap )
+    {
+        if( !nkeys ){
+            lua_pushliteral( L, "" );
+        }
+        else {
+            rv = las_batch_run_chunks( L, lbatch, chunk && nkeys > chunk ?
+                                                  chunk : nkeys );
+        }
+    }
+    else if( chunk && nkeys > chunk ){
+        rv = las_batch_run_chunks( L, lbatch, chunk );
+    }
+    else if( las_batch_request( lbatch, &lbatch->batch, &err,
+                                las_batch_cb( lbatch ),
+                                (void*)lbatch ) != AEROSPIKE_OK ){
+        lua_pushnil( L );
+        lua_pushstring( L, err.message );
+        rv = 2;
+    }
+    
+    return rv;
+}
+
+
+// MARK: streaming batch operation
+#define LAS_BATCH_EACH_STOP     1
+#define LAS_BATCH_EACH_ERROR    -1
+
+static bool batcheach_cb( const as_batch_read *results, uint32_t n,
+                          void *udata )
+{
+    las_batch_t *lbatch = (las_batch_t*)udata;
+    lua_State *L = lbatch->L;
+    uint32_t i = 0;
+    as_error err;
+    
+    for(; i < n; i++ )
+    {
+        // fn( pk, record or false or error message )
+        lua_pushvalue( L, lbatch->fn );
+        las_pk_push( L, results[i].key );
+        switch( results[i].result )
+        {
+            case AEROSPIKE_OK:
+                lua_createtable( L, 0, 3 );
+                if( lstate_asrec2result( L,
+                                         (as_record*)&results[i].record ) != 0 ){
+                    las_batch_pushdecerr( L );
+                }
+            break;
+            case AEROSPIKE_ERR_RECORD_NOT_FOUND:
+                lua_pushboolean( L, 0 );
+            break;
+            
+            // The transaction didn't succeed.
+            default:
+                as_error_init( &err );
+                LAS_SET_ASERROR( &err, results[i].result );
+                lua_pushstring( L, err.message );
+        }
+        
+        // error message will be left on the stack
+        if( lua_pcall( L, 2, 1, 0 ) != 0 ){
+            lbatch->status = LAS_BATCH_EACH_ERROR;
+            return false;
+        }
+        // stop if fn returned false
+        else if( lua_type( L, -1 ) == LUA_TBOOLEAN && !lua_toboolean( L, -1 ) ){
+            lbatch->status = LAS_BATCH_EACH_STOP;
+        }
+        lua_pop( L, 1 );
+        
+        if( lbatch->status ){
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+
+// call fn( pk, record or false or error message ) with each result
+int las_batch_each( lua_State *L, las_batch_t *lbatch, int fn )
+{
+    as_batch batch;
+    as_error err;
+    uint32_t size = 0;
+    uint32_t offset = 0;
+    
+    lbatch->fn = fn;
+    // keys are read chunk by chunk on this thread to bound the memory usage
+    size = lbatch->ctx->opt.chunk ? lbatch->ctx->opt.chunk :
+                                    lbatch->batch.keys.size;
+    for(; !lbatch->status && offset < lbatch->batch.keys.size; offset += size )
+    {
+        las_batch_chunkat( lbatch, &batch, offset, size );
+        if( aerospike_batch_get( lbatch->as, &err, lbatch->policy, &batch,
+                                 batcheach_cb, (void*)lbatch ) != AEROSPIKE_OK &&
+            !lbatch->status ){
+            lua_pushnil( L );
+            lua_pushstring( L, err.message );
+            return 2;
+        }
+    }
+    
+    // got error from fn
+    if( lbatch->status == LAS_BATCH_EACH_ERROR ){
+        lua_pushnil( L );
+        lua_insert( L, -2 );
+        return 2;
+    }
+    lua_pushboolean( L, 1 );
+    
+    return 1;
+}
+
+// MARK: batch write operations
+// transaction of the key that executed by the worker thread
+typedef struct {
+    as_key key;
+    as_record rec;
+    // buffer for the encoded bin values of rec
+    las_mpack_t mp;
+    // result of operate
+    as_record *res;
+    // result of apply
+    as_val *val;
+    as_status rc;
+    // error message of the failed transaction
+    char *emsg;
+} las_bwrite_ent_t;
+
+typedef struct {
+    aerospike *as;
+    las_ctx_t *ctx;
+    int op;
+    // operations of operate, or ttl of touch
+    las_ops_t *lops;
+    uint32_t ttl;
+    // operations of touch and operate for each worker thread; the client
+    // reserves and releases the bin values while sending them, so they are
+    // not shared by the threads.
+    as_operations *ops;
+    uint32_t nops;
+    // udf of apply and its arguments for each worker thread
+    const char *module;
+    const char *func;
+    as_arraylist *args;
+    uint32_t nargs;
+    las_bwrite_ent_t *ents;
+    uint32_t nents;
+} las_bwrite_t;
+
+
+static void las_bwrite_dispose( las_bwrite_t *bw )
+{
+    uint32_t i = 0;
+    
+    for(; i < bw->nents; i++ )
+    {
+        as_key_destroy( &bw->ents[i].key );
+        if( bw->op == LAS_BATCH_PUT ){
+            as_record_destroy( &bw->ents[i].rec );
+            las_mpack_dispose( &bw->ents[i].mp );
+        }
+        else if( bw->ents[i].res ){
+            as_record_destroy( bw->ents[i].res );
+        }
+        else if( bw->ents[i].val ){
+            as_val_destroy( bw->ents[i].val );
+        }
+        pdealloc( bw->ents[i].emsg );
+    }
+    for( i = 0; i < bw->nops; i++ ){
+        as_operations_destroy( &bw->ops[i] );
+    }
+    pdealloc( bw->ops );
+    free( bw->ents );
+}
+
+
+// build the operations of touch and operate for each worker thread.
+// returns -1 if failed.
+static int las_bwrite_setops( lua_State *L, las_bwrite_t *bw, uint32_t nslot )
+{
+    if( bw->op != LAS_BATCH_TOUCH && bw->op != LAS_BATCH_OPERATE ){
+        return 0;
+    }
+    else if( !( bw->ops = pnalloc( nslot, as_operations ) ) ){
+        return -1;
+    }
+    
+    for(; bw->nops < nslot; bw->nops++ )
+    {
+        if( bw->op == LAS_BATCH_OPERATE ){
+            if( !las_ops2asops( L, bw->lops, &bw->ops[bw->nops] ) ){
+                return -1;
+            }
+        }
+        else if( !as_operations_init( &bw->ops[bw->nops], 1 ) ){
+            return -1;
+        }
+        else {
+            as_operations_add_touch( &bw->ops[bw->nops] );
+            bw->ops[bw->nops].ttl = bw->ttl;
+        }
+    }
+    
+    return 0;
+}
+
+
+// convert the bins table at the top of stack into the record of ent.
+// the record will be released if failed.
+static int las_bwrite_setrec( lua_State *L, las_bwrite_ent_t *ent,
+                              uint32_t ttl, int idx )
+{
+    uint16_t nbins = 0;
+    
+    if( lua_type( L, -1 ) != LUA_TTABLE ){
+        lua_pushnil( L );
+        lua_pushfstring( L, "record#%d " LAS_ERR_RECORD_TYPE, idx );
+        return 2;
+    }
+    else if( lstate_tblnbins( L, &nbins ) != 0 ){
+        lua_pushnil( L );
+        lua_pushfstring( L, "record#%d %s", idx, lua_tostring( L, -2 ) );
+        return 2;
+    }
+    
+    as_record_init( &ent->rec, nbins );
+    las_mpack_init( &ent->mp );
+    if( las_mpack_tbl2asrec( L, &ent->rec, &ent->mp ) != 0 ){
+        as_record_destroy( &ent->rec );
+        las_mpack_dispose( &ent->mp );
+        lua_pushnil( L );
+        lua_pushfstring( L, "record#%d %s", idx, lua_tostring( L, -2 ) );
+        return 2;
+    }
+    ent->rec.ttl = ttl;
+    
+    return 0;
+}
+
+
+// called by the worker thread
+static void bwrite_run( uint32_t idx, uint32_t slot, void *udata )
+{
+    las_bwrite_t *bw = (las_bwrite_t*)udata;
+    las_bwrite_ent_t *ent = &bw->ents[idx];
+    as_policies *policies = &bw->ctx->policies;
+    as_error err;
+    
+    switch( bw->op ){
+        case LAS_BATCH_PUT:
+            ent->rc = aerospike_key_put( bw->as, &err, &policies->write,
+                                         &ent->key, &ent->rec );
+        break;
+        case LAS_BATCH_REMOVE:
+            ent->rc = aerospike_key_remove( bw->as, &err, &policies->remove,
+                                            &ent->key );
+        break;
+        case LAS_BATCH_OPERATE:
+            ent->rc = aerospike_key_operate( bw->as, &err, &policies->operate,
+                                             &ent->key, &bw->ops[slot],
+                                             &ent->res );
+        break;
+        case LAS_BATCH_APPLY:
+            ent->rc = aerospike_key_apply( bw->as, &err, &policies->apply,
+                                           &ent->key, bw->module, bw->func,
+                                           (as_list*)&bw->args[slot],
+                                           &ent->val );
+        break;
+        default:
+            ent->rc = aerospike_key_operate( bw->as, &err, &policies->operate,
+                                             &ent->key, &bw->ops[slot], NULL );
+    }
+    
+    if( ent->rc != AEROSPIKE_OK && ent->rc != AEROSPIKE_ERR_RECORD_NOT_FOUND ){
+        ent->emsg = strdup( err.message );
+    }
+}
+
+
+// push the error message of the failed transaction
+static inline void las_bwrite_pusherr( lua_State *L, las_bwrite_ent_t *ent )
+{
+    as_error err;
+    
+    if( ent->emsg ){
+        lua_pushstring( L, ent->emsg );
+    }
+    else {
+        as_error_init( &err );
+        LAS_SET_ASERROR( &err, ent->rc );
+        lua_pushstring( L, err.message );
+    }
+}
+
+
+// push true or the record of operate, false(not found) or error message of
+// each key in order of keys
+static void las_bwrite_pushres( lua_State *L, las_bwrite_t *bw )
+{
+    uint32_t i = 0;
+    
+    lua_createtable( L, (int)bw->nents, 0 );
+    for(; i < bw->nents; i++ )
+    {
+        switch( bw->ents[i].rc ){
+            case AEROSPIKE_OK:
+                if( bw->ents[i].res )
+                {
+                    lua_createtable( L, 0, 3 );
+                    if( lstate_asrec2result( L, bw->ents[i].res ) != 0 ){
+                        las_batch_pushdecerr( L );
+                    }
+                }
+                else {
+                    lua_pushboolean( L, 1 );
+                }
+            break;
+            case AEROSPIKE_ERR_RECORD_NOT_FOUND:
+                lua_pushboolean( L, 0 );
+            break;
+            
+            // The transaction didn't succeed.
+            default:
+                las_bwrite_pusherr( L, &bw->ents[i] );
+        }
+        lua_rawseti( L, -2, (int)i + 1 );
+    }
+}
+
+
+// push the result of each key in order of keys; { val = <udf result> } if
+// succeeded, val is nil if udf returned nil, or { err = <error message> }.
+static void las_bwrite_pushapply( lua_State *L, las_bwrite_t *bw )
+{
+    las_bwrite_ent_t *ent = NULL;
+    int rc = 0;
+    uint32_t i = 0;
+    
+    lua_createtable( L, (int)bw->nents, 0 );
+    for(; i < bw->nents; i++ )
+    {
+        ent = &bw->ents[i];
+        lua_createtable( L, 0, 1 );
+        if( ent->rc == AEROSPIKE_OK )
+        {
+            rc = ent->val ? lstate_asval2lua( L, ent->val ) : 0;
+            if( rc == 1 ){
+                lua_setfield( L, -2, "val" );
+            }
+            else if( rc == -1 ){
+                lua_pushliteral( L, LAS_ERR_BIN_DECODE );
+                lua_setfield( L, -2, "err" );
+            }
+            // udf returned nil
+            lua_rawseti( L, -2, (int)i + 1 );
+            continue;
+        }
+        
+        las_bwrite_pusherr( L, ent );
+        lua_setfield( L, -2, "err" );
+        lua_rawseti( L, -2, (int)i + 1 );
+    }
+}
+
+
+// keys: kidx = { key, ... }, records of put: kidx + 1 = { bins, ... }
+static int las_bwrite_exec( lua_State *L, las_bwrite_t *bw, int kidx )
+{
+    las_ctx_t *ctx = bw->ctx;
+    uint32_t nkeys = (uint32_t)lua_objlen( L, kidx );
+    uint32_t nslot = las_worker_nthread( nkeys, ctx->opt.concurrency );
+    las_bwrite_ent_t *ent = NULL;
+    const char *errstr = NULL;
+    int rv = 0;
+    
+    if( !nkeys ){
+        las_bwrite_dispose( bw );
+        lua_newtable( L );
+        return 1;
+    }
+    else if( !( bw->ents = pcalloc( nkeys, las_bwrite_ent_t ) ) ){
+        las_bwrite_dispose( bw );
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    // keys and records are prepared on this thread
+    for(; bw->nents < nkeys; bw->nents++ )
+    {
+        ent = &bw->ents[bw->nents];
+        lua_rawgeti( L, kidx, (int)bw->nents + 1 );
+        if( !las_pk_init( L, -1, ctx->ns, ctx->set, &ent->key ) ){
+            errstr = las_pk_strerror( L, -1 );
+            las_bwrite_dispose( bw );
+            lua_pushnil( L );
+            lua_pushfstring( L, "key#%d %s", (int)bw->nents + 1, errstr );
+            return 2;
+        }
+        // pk string is held by the array
+        lua_pop( L, 1 );
+        
+        if( bw->op == LAS_BATCH_PUT )
+        {
+            lua_rawgeti( L, kidx + 1, (int)bw->nents + 1 );
+            rv = las_bwrite_setrec( L, ent, bw->ttl, (int)bw->nents + 1 );
+            if( rv != 0 ){
+                as_key_destroy( &ent->key );
+                las_bwrite_dispose( bw );
+                return rv;
+            }
+            lua_pop( L, 1 );
+        }
+    }
+    
+    if( las_bwrite_setops( L, bw, nslot ) != 0 ){
+        las_bwrite_dispose( bw );
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    // apply is run by the threads that hold the arguments
+    if( bw->op == LAS_BATCH_APPLY && nslot > bw->nargs ){
+        nslot = bw->nargs;
+    }
+    las_worker_run( nkeys, nslot, bwrite_run, (void*)bw );
+    if( bw->op == LAS_BATCH_APPLY ){
+        las_bwrite_pushapply( L, bw );
+    }
+    else {
+        las_bwrite_pushres( L, bw );
+    }
+    las_bwrite_dispose( bw );
+    
+    return 1;
+}
+
+
+// keys: kidx = { key, ... }
+// put: records: kidx + 1 = { bins, ... }, ttl: kidx + 2
+// touch: ttl: kidx + 1
+int las_batch_write( lua_State *L, aerospike *as, las_ctx_t *ctx, int op,
+                     int kidx )
+{
+    las_bwrite_t bw = {
+        .as = as,
+        .ctx = ctx,
+        .op = op,
+        .lops = NULL,
+        .ttl = 0,
+        .ops = NULL,
+        .nops = 0,
+        .args = NULL,
+        .nargs = 0,
+        .ents = NULL,
+        .nents = 0
+    };
+    lua_Integer ttl = op == LAS_BATCH_PUT ? -1 : 0;
+    int tidx = op == LAS_BATCH_PUT ? kidx + 2 : kidx + 1;
+    
+    luaL_checktype( L, kidx, LUA_TTABLE );
+    if( op == LAS_BATCH_PUT && ( !lua_istable( L, kidx + 1 ) ||
+        lua_objlen( L, kidx + 1 ) != lua_objlen( L, kidx ) ) ){
+        return luaL_argerror( L, kidx + 1,
+                              "records must be array of bins in order of keys" );
+    }
+    // check ttl
+    else if( op != LAS_BATCH_REMOVE && !lua_isnoneornil( L, tidx ) )
+    {
+        ttl = lstate_checkinteger( L, tidx );
+        if( ttl < -1 || ttl > UINT32_MAX ){
+            lua_pushnil( L );
+            lua_pushliteral( L, LAS_ERR_TTL_RANGE );
+            return 2;
+        }
+    }
+    
+    bw.ttl = (uint32_t)ttl;
+    
+    return las_bwrite_exec( L, &bw, kidx );
+}
+
+
+// operations: lops, keys: kidx = { key, ... }
+int las_batch_operate( lua_State *L, aerospike *as, las_ctx_t *ctx,
+                       las_ops_t *lops, int kidx )
+{
+    las_bwrite_t bw = {
+        .as = as,
+        .ctx = ctx,
+        .op = LAS_BATCH_OPERATE,
+        .lops = lops,
+        .ttl = 0,
+        .ops = NULL,
+        .nops = 0,
+        .args = NULL,
+        .nargs = 0,
+        .ents = NULL,
+        .nents = 0
+    };
+    
+    luaL_checktype( L, kidx, LUA_TTABLE );
+    
+    // operations are converted for each worker thread
+    return las_bwrite_exec( L, &bw, kidx );
+}
+
+
+// keys: kidx = { key, ... }, args: arguments for each worker thread.
+// in-flight transactions are bounded by the concurrency of ctx and nargs.
+int las_batch_apply( lua_State *L, aerospike *as, las_ctx_t *ctx, int kidx,
+                     const char *module, const char *func, as_arraylist *args,
+                     uint32_t nargs )
+{
+    las_bwrite_t bw = {
+        .as = as,
+        .ctx = ctx,
+        .op = LAS_BATCH_APPLY,
+        .lops = NULL,
+        .ttl = 0,
+        .ops = NULL,
+        .nops = 0,
+        .module = module,
+        .func = func,
+        .args = args,
+        .nargs = nargs,
+        .ents = NULL,
+        .nents = 0
+    };
+    
+    luaL_checktype( L, kidx, LUA_TTABLE );
+    
+    return las_bwrite_exec( L, &bw, kidx );
+}
+
+
+// MARK: prepared batch
+// result table: into
+static int pbatch_run( lua_State *L, int op, int into )
+{
+    las_pbatch_t *pb = luaL_checkudata( L, 1, LAS_BATCH_MT );
+    las_batch_t lbatch;
+    
+    las_batch_init( L, &lbatch, pb->as, pb->ctx, op );
+    // keys are owned by the prepared batch
+    lbatch.batch = pb->batch;
+    lbatch.pos = pb->pos;
+    las_batch_setinto( L, &lbatch, lua_istable( L, into ) ? into : 0 );
+    
+    return las_batch_run( L, &lbatch );
+}
+
+
+static int get_lua( lua_State *L )
+{
+    return pbatch_run( L, LAS_BATCH_GET, 2 );
+}
+
+
+static int exists_lua( lua_State *L )
+{
+    return pbatch_run( L, LAS_BATCH_EXISTS, 2 );
+}
+
+
+// bin names: 2 = { bin, ... }
+static int select_lua( lua_State *L )
+{
+    las_pbatch_t *pb = luaL_checkudata( L, 1, LAS_BATCH_MT );
+    las_batch_t lbatch;
+    size_t nbins = 0;
+    const char **bins = NULL;
+    int rv = las_batch_checkbins( L, 2, &nbins );
+    
+    if( rv != 0 ){
+        return rv;
+    }
+    // bin names + null-terminator
+    else if( !( bins = pnalloc( nbins + 1, const char* ) ) ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    las_batch_init( L, &lbatch, pb->as, pb->ctx, LAS_BATCH_SELECT );
+    if( ( rv = las_batch_setbins( L, &lbatch, 2, bins, nbins ) ) == 0 ){
+        lbatch.batch = pb->batch;
+        lbatch.pos = pb->pos;
+        las_batch_setinto( L, &lbatch, lua_istable( L, 3 ) ? 3 : 0 );
+        rv = las_batch_run( L, &lbatch );
+    }
+    pdealloc( bins );
+    
+    return rv;
+}
+
+
+static int len_lua( lua_State *L )
+{
+    las_pbatch_t *pb = luaL_checkudata( L, 1, LAS_BATCH_MT );
+    
+    lua_pushinteger( L, pb->pos.nkeys );
+    
+    return 1;
+}
+
+
+static int tostring_lua( lua_State *L )
+{
+    return TOSTRING_MT( L, LAS_BATCH_MT );
+}
+
+
+static int gc_lua( lua_State *L )
+{
+    las_pbatch_t *pb = (las_pbatch_t*)lua_touserdata( L, 1 );
+    
+    as_batch_destroy( &pb->batch );
+    pdealloc( pb->pos.upos );
+    lstate_unref( L, pb->ref_keys );
+    lstate_unref( L, pb->ref_ctx );
+    
+    return 0;
+}
+
+
+// ctx: 1, keys: 2 = { key, ... }
+static int alloc_lua( lua_State *L )
+{
+    las_ctx_t *ctx = luaL_checkudata( L, 1, LAS_CONTEXT_MT );
+    uint32_t nkeys = 0;
+    uint32_t idx = 0;
+    las_pbatch_t *pb = NULL;
+    las_conn_t *conn = NULL;
+    as_key *key = NULL;
+    const char *errstr = NULL;
+    
+    if( !lua_istable( L, 2 ) || !( nkeys = (uint32_t)lua_objlen( L, 2 ) ) ){
+        return luaL_argerror( L, 2, "keys must be array of keys" );
+    }
+    lua_settop( L, 2 );
+    
+    // copy of keys: 3
+    lua_createtable( L, (int)nkeys, 0 );
+    if( !( pb = lua_newuserdata( L, sizeof( las_pbatch_t ) ) ) ||
+        !as_batch_init( &pb->batch, nkeys ) ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    // init keys and calculate its digests
+    for(; idx < nkeys; idx++ )
+    {
+        lua_rawgeti( L, 2, (int)idx + 1 );
+        key = las_pk_init( L, -1, ctx->ns, ctx->set,
+                           as_batch_keyat( &pb->batch, idx ) );
+        if( !key ){
+            errstr = las_pk_strerror( L, -1 );
+            // number of initialized keys
+            pb->batch.keys.size = idx;
+            as_batch_destroy( &pb->batch );
+            lua_pushnil( L );
+            lua_pushfstring( L, "key#%d %s", (int)idx + 1, errstr );
+            return 2;
+        }
+        // pk value is held by the copy of keys
+        lua_rawseti( L, 3, (int)idx + 1 );
+    }
+    // digests are calculated by deduplication
+    if( las_batch_dedup( &pb->batch, &pb->pos ) != 0 ){
+        as_batch_destroy( &pb->batch );
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    lstate_pushref( L, ctx->ref_conn );
+    conn = lua_touserdata( L, -1 );
+    lua_pop( L, 1 );
+    pb->as = conn->as;
+    pb->ctx = ctx;
+    pb->ref_ctx = lstate_ref( L, 1 );
+    pb->ref_keys = lstate_ref( L, 3 );
+    lstate_setmetatable( L, LAS_BATCH_MT );
+    
+    return 1;
+}
+
+
+LUALIB_API int luaopen_aerospike_batch( lua_State *L )
+{
+    struct luaL_Reg mmethod[] = {
+        { "__gc", gc_lua },
+        { "__tostring", tostring_lua },
+        { "__len", len_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg method[] = {
+        { "get", get_lua },
+        { "exists", exists_lua },
+        { "select", select_lua },
+        { NULL, NULL }
+    };
+    
+    lstate_definemt( L, LAS_BATCH_MT, mmethod, method );
+    // add methods
+    lua_pushcfunction( L, alloc_lua );
+    
+    return 1;
+}
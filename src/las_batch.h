@@ -0,0 +1,123 @@
+/*
+ *  Copyright 2014 Masatoshi Teruya. All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  las_batch.h
+ *  lua-aerospike
+ *
+ *  Created by Masatoshi Teruya on 2014/09/17.
+ *
+ */
+
+#ifndef lua_aerospike_las_batch_h
+#define lua_aerospike_las_batch_h
+
+#include "las.h"
+#include "las_ctx.h"
+#include "las_ops.h"
+
+// types of batch operation
+#define LAS_BATCH_GET       0
+#define LAS_BATCH_EXISTS    1
+#define LAS_BATCH_SELECT    2
+#define LAS_BATCH_PUT       3
+#define LAS_BATCH_REMOVE    4
+#define LAS_BATCH_TOUCH     5
+#define LAS_BATCH_OPERATE   6
+#define LAS_BATCH_APPLY     7
+
+// positions of the keys that passed by caller.
+// upos and ufirst are NULL if there are no duplicated keys.
+typedef struct {
+    uint32_t nkeys;
+    // index of the unique key at each position
+    uint32_t *upos;
+    // first position of each unique key
+    uint32_t *ufirst;
+} las_batch_pos_t;
+
+#define las_batch_upos( pos, i ) \
+    ((pos)->upos ? (pos)->upos[i] : (i))
+
+#define las_batch_ufirst( pos, i ) \
+    ((pos)->ufirst ? (pos)->ufirst[i] : (i))
+
+typedef struct {
+    aerospike *as;
+    las_ctx_t *ctx;
+    void *policy;
+    lua_State *L;
+    as_batch batch;
+    las_batch_pos_t pos;
+    int op;
+    int ordered;
+    // bin names of LAS_BATCH_SELECT
+    const char **bins;
+    uint32_t nbins;
+    // result table and the pool of reusable record tables
+    int into;
+    int pool;
+    int npool;
+    // callback function of batchEach and its status
+    int fn;
+    int status;
+} las_batch_t;
+
+// prepared batch: keys and its digests are initialized at once when it is
+// created. ref_keys is the copy of keys array that holds the pk values.
+typedef struct {
+    as_batch batch;
+    las_batch_pos_t pos;
+    aerospike *as;
+    las_ctx_t *ctx;
+    int ref_ctx;
+    int ref_keys;
+} las_pbatch_t;
+
+#define las_batch_dispose( lbatch ) do { \
+    as_batch_destroy( &(lbatch)->batch ); \
+    pdealloc( (lbatch)->pos.upos ); \
+}while(0)
+
+
+// prototypes
+LUALIB_API int luaopen_aerospike_batch( lua_State *L );
+
+void las_batch_init( lua_State *L, las_batch_t *lbatch, aerospike *as,
+                     las_ctx_t *ctx, int op );
+int las_batch_setkeys( lua_State *L, las_batch_t *lbatch, int kidx,
+                       int nkeys );
+void las_batch_setinto( lua_State *L, las_batch_t *lbatch, int into );
+int las_batch_checkbins( lua_State *L, int idx, size_t *nbins );
+int las_batch_setbins( lua_State *L, las_batch_t *lbatch, int idx,
+                       const char *bins[], size_t nbins );
+int las_batch_run( lua_State *L, las_batch_t *lbatch );
+int las_batch_each( lua_State *L, las_batch_t *lbatch, int fn );
+int las_batch_write( lua_State *L, aerospike *as, las_ctx_t *ctx, int op,
+                     int kidx );
+int las_batch_operate( lua_State *L, aerospike *as, las_ctx_t *ctx,
+                       las_ops_t *lops, int kidx );
+int las_batch_apply( lua_State *L, aerospike *as, las_ctx_t *ctx, int kidx,
+                     const char *module, const char *func, as_arraylist *args,
+                     uint32_t nargs );
+
+
+#endif
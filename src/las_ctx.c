@@ -30,6 +30,10 @@
 #include "las_ctx.h"
 #include "las_record.h"
 #include "las_ops.h"
+#include "las_key.h"
+#include "las_worker.h"
+#include "las_batch.h"
+#include "las_scan.h"
 
 static inline las_ctx_t *get_context( lua_State *L, las_conn_t **conn )
 {
@@ -46,27 +50,29 @@ static inline las_ctx_t *get_context( lua_State *L, las_conn_t **conn )
 // MARK: key operations
 typedef struct {
     aerospike *as;
+    las_ctx_t *ctx;
     void *policy;
     as_key *key;
     as_record *rec;
+    // storage for key and record on the caller stack
+    as_key key_st;
+    as_record rec_st;
 } las_key_t;
 
 
 static inline int las_key_init( lua_State *L, las_key_t *lkey, int nbins,
                                 las_ctx_t *ctx )
 {
-    const char *pk = lstate_checkstring( L, 2 );
-    
-    if( !( lkey->key = as_key_new( ctx->ns, ctx->set, pk ) ) ){
-        return -1;
+    // pk string will be held by the lua stack until the operation is done
+    if( !( lkey->key = las_pk_check( L, 2, ctx->ns, ctx->set, &lkey->key_st ) ) ){
+        return luaL_argerror( L, 2, las_pk_strerror( L, 2 ) );
     }
     // init record
     if( nbins < 0 ){
         lkey->rec = NULL;
     }
-    else if( !( lkey->rec = as_record_new( (uint16_t)nbins ) ) ){
-        as_key_destroy( lkey->key );
-        return -1;
+    else {
+        lkey->rec = as_record_init( &lkey->rec_st, (uint16_t)nbins );
     }
     
     return 0;
@@ -76,29 +82,33 @@ static inline int las_key_init( lua_State *L, las_key_t *lkey, int nbins,
     las_conn_t *_conn = NULL; \
     las_ctx_t *_ctx = get_context( L, &_conn ); \
     (lkey)->as = _conn->as; \
+    (lkey)->ctx = _ctx; \
     (lkey)->policy = (void*)&_ctx->policies.type; \
     las_key_init( L, (lkey), nbins, _ctx ); \
 })
 
 #define las_key_write_init(L,lkey)      las_key_init_prepare(L,lkey,-1,write)
 #define las_key_read_init(L,lkey)       las_key_init_prepare(L,lkey,0,read)
-#define las_key_remove_init(L,lkey)     las_key_init_prepare(L,lkey,0,remove)
-#define las_key_operate_init(L,lkey)    las_key_init_prepare(L,lkey,-1,operate)
+#define las_key_remove_init(L,lkey)     las_key_init_prepare(L,lkey,-1,remove)
+#define las_key_operate_init(L,lkey)    las_key_init_prepare(L,lkey,0,operate)
 #define las_key_apply_init(L,lkey)      las_key_init_prepare(L,lkey,-1,apply)
 
+// prepared key will be released by its owner
 #define las_key_dispose( lkey ) do { \
     as_record_destroy( (lkey)->rec ); \
-    as_key_destroy( (lkey)->key ); \
+    if( (lkey)->key == &(lkey)->key_st ){ \
+        as_key_destroy( (lkey)->key ); \
+    } \
 }while(0)
 
 
 static int put_lua( lua_State *L )
 {
     int rv = 1;
-    as_record rec;
-    las_key_t lkey = { .rec = &rec };
+    las_key_t lkey;
     as_error err;
     lua_Integer ttl = -1;
+    uint16_t nbins = 0;
     
     if( las_key_write_init( L, &lkey ) != 0 ){
         lua_pushboolean( L, 0 );
@@ -123,8 +133,22 @@ static int put_lua( lua_State *L )
         lua_settop( L, 3 );
     }
     
+    // check number of bins
+    if( lstate_tblnbins( L, &nbins ) != 0 ){
+        las_key_dispose( &lkey );
+        return 2;
+    }
+    // bins of the small record will be allocated on the stack
+    else if( nbins <= LAS_RECORD_NBINS_STACK ){
+        as_record_inita( &lkey.rec_st, nbins );
+    }
+    else {
+        as_record_init( &lkey.rec_st, nbins );
+    }
+    lkey.rec = &lkey.rec_st;
+    
     // read table
-    if( !( lkey.rec = lstate_tbl2asrec( L ) ) ){
+    if( las_mpack_tbl2asrec( L, lkey.rec, &lkey.ctx->mpack ) != 0 ){
         las_key_dispose( &lkey );
         return 2;
     }
@@ -151,6 +175,8 @@ static int put_lua( lua_State *L )
 static int get_lua( lua_State *L )
 {
     int rv = 1;
+    // result table
+    int into = lua_istable( L, 3 ) ? 3 : 0;
     las_key_t lkey;
     as_error err;
     
@@ -162,12 +188,13 @@ static int get_lua( lua_State *L )
     
     switch( aerospike_key_get( lkey.as, &err, lkey.policy, lkey.key, &lkey.rec ) ){
         case AEROSPIKE_OK:
-            lua_createtable( L, 0, 3 );
-            lstate_num2tbl( L, "ttl", lkey.rec->ttl );
-            lstate_num2tbl( L, "gen", lkey.rec->gen );
-            lua_pushstring( L, "bins" );
-            lstate_asrec2tbl( L, lkey.rec );
-            lua_rawset( L, -3 );
+            lstate_pushinto( L, into, 0, 3 );
+            if( lstate_asrec2result( L, lkey.rec ) != 0 ){
+                lua_pop( L, 1 );
+                lua_pushnil( L );
+                lua_pushliteral( L, LAS_ERR_BIN_DECODE );
+                rv++;
+            }
         break;
         
         default:
@@ -181,13 +208,47 @@ static int get_lua( lua_State *L )
 }
 
 
+// number of bin names that can be held by the array on the stack
+#define LAS_BINNAMES_NSTACK 16
+
+// bin names: 3...N + null-terminator are held by the heap if the array on
+// the stack is not enough
+#define las_binnames_alloc( argc, stackbins ) \
+    ( (argc) - 1 > LAS_BINNAMES_NSTACK ? \
+      pnalloc( (argc) - 1, const char* ) : (stackbins) )
+
+#define las_binnames_dispose( bins, stackbins ) do { \
+    if( (bins) != (stackbins) ){ \
+        pdealloc( bins ); \
+    } \
+}while(0)
+
+
+// set bin names: 3...N + null-terminator
+static int las_binnames_init( lua_State *L, int argc, const char *bins[] )
+{
+    int idx = 3;
+    
+    for(; idx <= argc; idx++ )
+    {
+        if( !( bins[idx-3] = LAS_CHK_BINNAME( L, idx ) ) ){
+            return -1;
+        }
+    }
+    bins[idx-3] = NULL;
+    
+    return 0;
+}
+
+
 static int select_lua( lua_State *L )
 {
     int rv = 1;
     int argc = lua_gettop( L );
+    // result table: last argument
+    int into = argc > 2 && lua_istable( L, argc ) ? argc-- : 0;
+    const char *stackbins[LAS_BINNAMES_NSTACK];
     const char **bins = NULL;
-    const char *binname = NULL;
-    int idx = 3;
     las_key_t lkey;
     as_error err;
     
@@ -196,36 +257,30 @@ static int select_lua( lua_State *L )
         lua_pushstring( L, strerror( errno ) );
         return 2;
     }
-    else if( !( bins = pnalloc( argc + 1, const char* ) ) ){
+    else if( !( bins = las_binnames_alloc( argc, stackbins ) ) ){
         las_key_dispose( &lkey );
         lua_pushnil( L );
         lua_pushstring( L, strerror( errno ) );
         return 2;
     }
-    
-    // set bin names
-    for(; idx <= argc; idx++ )
-    {
-        if( !( binname = LAS_CHK_BINNAME( L, idx ) ) ){
-            las_key_dispose( &lkey );
-            pdealloc( bins );
-            lua_pushnil( L );
-            lua_pushliteral( L, LAS_ERR_BIN_NAME );
-            return 2;
-        }
-        bins[idx-3] = binname;
+    else if( las_binnames_init( L, argc, bins ) != 0 ){
+        las_key_dispose( &lkey );
+        las_binnames_dispose( bins, stackbins );
+        lua_pushnil( L );
+        lua_pushliteral( L, LAS_ERR_BIN_NAME );
+        return 2;
     }
-    bins[idx-3] = NULL;
     
     switch( aerospike_key_select( lkey.as, &err, lkey.policy, lkey.key, bins,
                                   &lkey.rec ) ){
         case AEROSPIKE_OK:
-            lua_createtable( L, 0, 3 );
-            lstate_num2tbl( L, "ttl", lkey.rec->ttl );
-            lstate_num2tbl( L, "gen", lkey.rec->gen );
-            lua_pushstring( L, "bins" );
-            lstate_asrec2tbl( L, lkey.rec );
-            lua_rawset( L, -3 );
+            lstate_pushinto( L, into, 0, 3 );
+            if( lstate_asrec2result( L, lkey.rec ) != 0 ){
+                lua_pop( L, 1 );
+                lua_pushnil( L );
+                lua_pushliteral( L, LAS_ERR_BIN_DECODE );
+                rv++;
+            }
         break;
         
         default:
@@ -234,12 +289,71 @@ static int select_lua( lua_State *L )
             rv++;
     }
     las_key_dispose( &lkey );
-    pdealloc( bins );
+    las_binnames_dispose( bins, stackbins );
     
     return rv;
 }
 
 
+// read bins into the aerospike.record that converts them on demand
+static int getrecord_lua( lua_State *L )
+{
+    int argc = lua_gettop( L );
+    const char *stackbins[LAS_BINNAMES_NSTACK];
+    const char **bins = NULL;
+    las_key_t lkey;
+    las_record_t *lrec = NULL;
+    as_status rc = AEROSPIKE_OK;
+    as_error err;
+    
+    if( las_key_read_init( L, &lkey ) != 0 ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    // allocate the record before the bin names, so that the bin names will
+    // not be leaked by a memory error
+    else if( !( lrec = las_record_alloc( L, 2 ) ) ||
+             !( bins = las_binnames_alloc( argc, stackbins ) ) ){
+        las_key_dispose( &lkey );
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    else if( las_binnames_init( L, argc, bins ) != 0 ){
+        las_key_dispose( &lkey );
+        las_binnames_dispose( bins, stackbins );
+        lua_pushnil( L );
+        lua_pushliteral( L, LAS_ERR_BIN_NAME );
+        return 2;
+    }
+    
+    // bins will be owned by lrec
+    lkey.rec = &lrec->rec;
+    if( argc > 2 ){
+        rc = aerospike_key_select( lkey.as, &err, lkey.policy, lkey.key, bins,
+                                   &lkey.rec );
+    }
+    else {
+        rc = aerospike_key_get( lkey.as, &err, lkey.policy, lkey.key,
+                                &lkey.rec );
+    }
+    lkey.rec = NULL;
+    las_key_dispose( &lkey );
+    las_binnames_dispose( bins, stackbins );
+    
+    if( rc == AEROSPIKE_OK ){
+        return 1;
+    }
+    
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, err.message );
+    
+    return 2;
+}
+
+
 static int exists_lua( lua_State *L )
 {
     int rv = 1;
@@ -328,8 +442,15 @@ static int operate_lua( lua_State *L )
                 lstate_num2tbl( L, "ttl", lkey.rec->ttl );
                 lstate_num2tbl( L, "gen", lkey.rec->gen );
                 lua_pushstring( L, "bins" );
-                lstate_asrec2tbl( L, lkey.rec );
-                lua_rawset( L, -3 );
+                if( lstate_asrec2tbl( L, lkey.rec ) == -1 ){
+                    lua_pop( L, 2 );
+                    lua_pushnil( L );
+                    lua_pushliteral( L, LAS_ERR_BIN_DECODE );
+                    rv++;
+                }
+                else {
+                    lua_rawset( L, -3 );
+                }
             break;
             
             default:
@@ -359,14 +480,11 @@ typedef enum {
     LAS_APPLY_ESYS
 } las_apply_args_err_t;
 
-static int set_apply_args( lua_State *L, const int argc,
-                           las_apply_args_t *apply, const int idx )
+static int set_apply_func( lua_State *L, las_apply_args_t *apply,
+                           const int idx )
 {
     const int module_idx = idx;
     const int func_idx = idx + 1;
-    const int nargs = argc - func_idx;
-    int args_idx = idx + 2;
-    as_val *val = NULL;
     size_t len = 0;
 
     // arg#3 module
@@ -381,8 +499,18 @@ static int set_apply_args( lua_State *L, const int argc,
              len > AS_UDF_FUNCTION_MAX_LEN ){
         return LAS_APPLY_EFUNCTION;
     }
-    // arg#5 arguments for function
-    else if( !as_arraylist_init( &apply->args, nargs, 0 ) ){
+    
+    return 0;
+}
+
+
+// arguments for function: args_idx...argc
+static int set_apply_arglist( lua_State *L, const int argc, as_arraylist *args,
+                              int args_idx )
+{
+    as_val *val = NULL;
+    
+    if( !as_arraylist_init( args, argc - args_idx + 1, 0 ) ){
         return LAS_APPLY_ESYS;
     }
     
@@ -391,26 +519,25 @@ static int set_apply_args( lua_State *L, const int argc,
     {
         switch( lua_type( L, args_idx ) ){
             case LUA_TSTRING:
-                as_arraylist_append_str( &apply->args,
-                                         lua_tostring( L, args_idx ) );
+                as_arraylist_append_str( args, lua_tostring( L, args_idx ) );
             break;
             case LUA_TNUMBER:
-                as_arraylist_append_int64( &apply->args,
+                as_arraylist_append_int64( args,
                                            lua_tointeger( L, args_idx ) );
             break;
             case LUA_TTABLE:
                 lua_pushvalue( L, args_idx );
                 if( !( val = lstate_tbl2asval( L ) ) ){
-                    as_arraylist_destroy( &apply->args );
+                    as_arraylist_destroy( args );
                     return LAS_APPLY_EARGS;
                 }
                 lua_pop( L, 1 );
-                as_arraylist_append( &apply->args, val );
+                as_arraylist_append( args, val );
             break;
             
             case LUA_TNONE:
             case LUA_TNIL:
-                as_arraylist_append( &apply->args, (as_val*)&as_nil );
+                as_arraylist_append( args, (as_val*)&as_nil );
             break;
             
             // LUA_TBOOLEAN
@@ -419,7 +546,7 @@ static int set_apply_args( lua_State *L, const int argc,
             // LUA_TUSERDATA
             // LUA_TLIGHTUSERDATA
             default:
-                as_arraylist_destroy( &apply->args );
+                as_arraylist_destroy( args );
                 lua_pushnil( L );
                 lua_pushfstring( L, LAS_ERR_UDF_ARGUMENT "%s data",
                                  lua_typename( L, lua_type( L, args_idx ) ) );
@@ -431,6 +558,20 @@ static int set_apply_args( lua_State *L, const int argc,
 }
 
 
+static int set_apply_args( lua_State *L, const int argc,
+                           las_apply_args_t *apply, const int idx )
+{
+    int rc = set_apply_func( L, apply, idx );
+    
+    // arg#5 arguments for function
+    if( rc == 0 ){
+        rc = set_apply_arglist( L, argc, &apply->args, idx + 2 );
+    }
+    
+    return rc;
+}
+
+
 static int apply_lua( lua_State *L )
 {
     int argc = lua_gettop( L );
@@ -476,8 +617,15 @@ static int apply_lua( lua_State *L )
                                  apply.module, apply.func,
                                  (as_list*)&apply.args, &res ) ){
         case AEROSPIKE_OK:
-            if( !lstate_asval2lua( L, res ) ){
-                lua_pushnil( L );
+            switch( lstate_asval2lua( L, res ) ){
+                case 0:
+                    lua_pushnil( L );
+                break;
+                case -1:
+                    lua_pushnil( L );
+                    lua_pushliteral( L, LAS_ERR_BIN_DECODE );
+                    rv++;
+                break;
             }
             as_val_destroy( res );
         break;
@@ -496,117 +644,102 @@ static int apply_lua( lua_State *L )
 
 // MARK: batch operations
 
-typedef struct {
-    aerospike *as;
-    void *policy;
-    lua_State *L;
-    as_batch batch;
-    int existence;
-} las_batch_t;
-
-
-static int las_batch_init( lua_State *L, las_batch_t *lbatch, int exists )
+// keys: kidx...N or kidx = { key, ... }, result table: last argument
+static int batch_prepare( lua_State *L, las_batch_t *lbatch, int op, int kidx )
 {
     int argc = lua_gettop( L );
     las_conn_t *conn = NULL;
     las_ctx_t *ctx = get_context( L, &conn );
-    int idx = 2;
+    int into = 0;
+    int rv = 0;
     
-    lbatch->as = conn->as;
-    lbatch->L = L;
-    lbatch->existence = exists;
-    lbatch->policy = &ctx->policies.batch;
+    las_batch_init( L, lbatch, conn->as, ctx, op );
+    if( lua_istable( L, kidx ) ){
+        into = lua_istable( L, kidx + 1 ) ? kidx + 1 : 0;
+    }
+    else if( argc > kidx && lua_istable( L, argc ) ){
+        into = argc--;
+    }
     
-    // keys: 2...N
-    if( !as_batch_init( &lbatch->batch, argc - 1 ) ){
-        lua_pushnil( L );
-        lua_pushstring( L, strerror( errno ) );
-        return 2;
+    if( ( rv = las_batch_setkeys( L, lbatch, kidx, argc - kidx + 1 ) ) == 0 ){
+        las_batch_setinto( L, lbatch, into );
     }
-    // set key names
-    for(; idx <= argc; idx++ )
-    {
-        if( lua_type( L, idx ) != LUA_TSTRING ){
-            lbatch->batch.keys.size = idx - 1;
-            as_batch_destroy( &lbatch->batch );
-            lua_pushnil( L );
-            lua_pushfstring( L, "key#%d must be type of string", idx-1 );
-            return 2;
-        }
-        as_key_init( as_batch_keyat( &lbatch->batch, idx - 2 ), ctx->ns,
-                     ctx->set, lua_tostring( L, idx ) );
+    
+    return rv;
+}
+
+
+// run the batch operation and release the keys
+static int batch_run( lua_State *L, las_batch_t *lbatch )
+{
+    int rv = las_batch_run( L, lbatch );
+    
+    las_batch_dispose( lbatch );
+    
+    return rv;
+}
+
+
+static int batchget_lua( lua_State *L )
+{
+    las_batch_t lbatch;
+    int rv = batch_prepare( L, &lbatch, LAS_BATCH_GET, 2 );
+    
+    if( rv != 0 ){
+        return rv;
     }
     
-    return 0;
+    return batch_run( L, &lbatch );
 }
 
 
-static bool batchget_cb( const as_batch_read *results, uint32_t n, void *udata )
+// keys: 2 = { key, ... }, fn: 3
+static int batcheach_lua( lua_State *L )
 {
-    las_batch_t *lbatch = (las_batch_t*)udata;
-    lua_State *L = lbatch->L;
-    uint32_t i = 0;
-    const char *key = NULL;
-    as_error err;
+    las_batch_t lbatch;
+    int rv = 0;
     
-    lua_createtable( L, 0, n );
-    for(; i < n; i++ )
-    {
-        key = as_string_get( (as_string*)&results[i].key->value );
-        switch( results[i].result )
-        {
-            case AEROSPIKE_OK:
-                if( lbatch->existence ){
-                    lstate_bool2tbl( L, key, 1 );
-                }
-                else {
-                    lua_pushstring( L, key );
-                    lua_createtable( L, 0, 3 );
-                    lstate_num2tbl( L, "ttl", results[i].record.ttl );
-                    lstate_num2tbl( L, "gen", results[i].record.gen );
-                    lua_pushstring( L, "bins" );
-                    lstate_asrec2tbl( L, (as_record*)&results[i].record );
-                    lua_rawset( L, -3 );
-                    lua_rawset( L, -3 );
-                }
-            break;
-            case AEROSPIKE_ERR_RECORD_NOT_FOUND:
-                if( lbatch->existence ){
-                    lstate_bool2tbl( L, key, 0 );
-                }
-            break;
-            
-            // The transaction didn't succeed.
-            default:
-                as_error_init( &err );
-                LAS_SET_ASERROR( &err, results[i].result );
-                lstate_str2tbl( L, key, err.message );
-        }
+    luaL_checktype( L, 2, LUA_TTABLE );
+    luaL_checktype( L, 3, LUA_TFUNCTION );
+    lua_settop( L, 3 );
+    
+    if( ( rv = batch_prepare( L, &lbatch, LAS_BATCH_GET, 2 ) ) != 0 ){
+        return rv;
     }
+    rv = las_batch_each( L, &lbatch, 3 );
+    las_batch_dispose( &lbatch );
     
-    return true;
+    return rv;
 }
 
 
-static int batchget_lua( lua_State *L )
+// bin names: 2 = { bin, ... }, keys: 3...N
+static int batchselect_lua( lua_State *L )
 {
-    as_error err;
     las_batch_t lbatch;
-    int rv = las_batch_init( L, &lbatch, 0 );
+    size_t nbins = 0;
+    const char **bins = NULL;
+    int rv = las_batch_checkbins( L, 2, &nbins );
     
     if( rv != 0 ){
         return rv;
     }
-    else if( aerospike_batch_get( lbatch.as, &err, lbatch.policy, &lbatch.batch,
-                                  batchget_cb, (void*)&lbatch ) != AEROSPIKE_OK ){
+    // bin names + null-terminator
+    else if( !( bins = pnalloc( nbins + 1, const char* ) ) ){
         lua_pushnil( L );
-        lua_pushstring( L, err.message );
-        rv = 2;
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
     }
-    else {
-        rv = 1;
+    else if( ( rv = batch_prepare( L, &lbatch, LAS_BATCH_SELECT, 3 ) ) == 0 )
+    {
+        if( ( rv = las_batch_setbins( L, &lbatch, 2, bins, nbins ) ) != 0 ){
+            las_batch_dispose( &lbatch );
+        }
+        else {
+            rv = batch_run( L, &lbatch );
+        }
     }
-    as_batch_destroy( &lbatch.batch );
+    pdealloc( bins );
     
     return rv;
 }
@@ -615,39 +748,144 @@ static int batchget_lua( lua_State *L )
 static int batchexists_lua( lua_State *L )
 {
     las_batch_t lbatch;
-    as_error err;
-    int rv = las_batch_init( L, &lbatch, 1 );
+    int rv = batch_prepare( L, &lbatch, LAS_BATCH_EXISTS, 2 );
     
     if( rv != 0 ){
         return rv;
     }
-    else if( aerospike_batch_exists( lbatch.as, &err, lbatch.policy,
-                                     &lbatch.batch, batchget_cb,
-                                     (void*)&lbatch ) != AEROSPIKE_OK ){
-        lua_pushnil( L );
-        lua_pushstring( L, err.message );
-        rv = 2;
+    
+    return batch_run( L, &lbatch );
+}
+
+
+
+// MARK: batch write operations
+// keys: 2 = { key, ... }, records: 3 = { bins, ... }, ttl: 4
+static int batchput_lua( lua_State *L )
+{
+    las_conn_t *conn = NULL;
+    las_ctx_t *ctx = get_context( L, &conn );
+    
+    return las_batch_write( L, conn->as, ctx, LAS_BATCH_PUT, 2 );
+}
+
+
+// keys: 2 = { key, ... }
+static int batchremove_lua( lua_State *L )
+{
+    las_conn_t *conn = NULL;
+    las_ctx_t *ctx = get_context( L, &conn );
+    
+    return las_batch_write( L, conn->as, ctx, LAS_BATCH_REMOVE, 2 );
+}
+
+
+// keys: 2 = { key, ... }, ttl: 3
+static int batchtouch_lua( lua_State *L )
+{
+    las_conn_t *conn = NULL;
+    las_ctx_t *ctx = get_context( L, &conn );
+    
+    return las_batch_write( L, conn->as, ctx, LAS_BATCH_TOUCH, 2 );
+}
+
+
+// operations: 2, keys: 3 = { key, ... }
+static int batchoperate_lua( lua_State *L )
+{
+    las_conn_t *conn = NULL;
+    las_ctx_t *ctx = get_context( L, &conn );
+    las_ops_t *lops = luaL_checkudata( L, 2, LAS_OPERATION_MT );
+    
+    return las_batch_operate( L, conn->as, ctx, lops, 3 );
+}
+
+
+// keys: 2 = { key, ... }, module: 3, function: 4, args: 5...N
+static int batchapply_lua( lua_State *L )
+{
+    int argc = lua_gettop( L );
+    las_conn_t *conn = NULL;
+    las_ctx_t *ctx = get_context( L, &conn );
+    las_apply_args_t apply;
+    as_arraylist *args = NULL;
+    uint32_t nargs = 0;
+    uint32_t i = 0;
+    int rv = 0;
+    
+    luaL_checktype( L, 2, LUA_TTABLE );
+    // arguments are converted for each worker thread
+    nargs = las_worker_nthread( (uint32_t)lua_objlen( L, 2 ),
+                                ctx->opt.concurrency );
+    if( !nargs ){
+        nargs = 1;
     }
-    else {
-        rv = 1;
+    if( !( rv = set_apply_func( L, &apply, 3 ) ) )
+    {
+        if( !( args = pnalloc( nargs, as_arraylist ) ) ){
+            rv = LAS_APPLY_ESYS;
+        }
+        else
+        {
+            for(; i < nargs; i++ )
+            {
+                if( ( rv = set_apply_arglist( L, argc, &args[i], 5 ) ) ){
+                    while( i-- ){
+                        as_arraylist_destroy( &args[i] );
+                    }
+                    pdealloc( args );
+                    break;
+                }
+            }
+        }
     }
-    as_batch_destroy( &lbatch.batch );
+    
+    switch( rv )
+    {
+        // check error
+        // arg#3 module
+        case LAS_APPLY_EMODULE:
+            luaL_checktype( L, 3, LUA_TSTRING );
+            return 1;
+        // arg#4 function
+        case LAS_APPLY_EFUNCTION:
+            luaL_checktype( L, 4, LUA_TSTRING );
+            return 1;
+        // failed to allocate or as_arraylist_init
+        case LAS_APPLY_ESYS:
+            lua_pushnil( L );
+            lua_pushstring( L, strerror( errno ) );
+            return 2;
+        // arg#5 arguments for function
+        case LAS_APPLY_EARGS:
+            lua_pushnil( L );
+            lua_replace( L, -3 );
+            return 2;
+    }
+    
+    rv = las_batch_apply( L, conn->as, ctx, 2, apply.module, apply.func, args,
+                          nargs );
+    for( i = 0; i < nargs; i++ ){
+        as_arraylist_destroy( &args[i] );
+    }
+    pdealloc( args );
     
     return rv;
 }
 
 
-
-
 // MARK: scan operations
 
 typedef struct {
     aerospike *as;
+    las_ctx_t *ctx;
     as_policy_scan *policy;
     as_policy_info *policy_info;
     lua_State *L;
     as_scan scan;
     int nitem;
+    // number of records that can be buffered by the scan queue
+    uint32_t qsize;
 } las_scan_t;
 
 
@@ -658,6 +896,7 @@ static int las_scan_init( lua_State *L, las_scan_t *lscan,
     las_ctx_t *ctx = get_context( L, &conn );
     const char *errstr = NULL;
     
+    lscan->qsize = LAS_SCAN_QSIZE;
     if( !as_scan_init( &lscan->scan, ctx->ns, ctx->set ) ){
         lua_pushnil( L );
         lua_pushstring( L, strerror( errno ) );
@@ -732,6 +971,20 @@ static int las_scan_init( lua_State *L, las_scan_t *lscan,
         }
         lua_pop( L, 1 );
         
+        // check buffer
+        lua_pushstring( L, "buffer" );
+        lua_rawget( L, 2 );
+        if( !lua_isnoneornil( L, -1 ) )
+        {
+            if( lua_type( L, -1 ) != LUA_TNUMBER ||
+                ( val = lua_tointeger( L, -1 ) ) < 1 || val > UINT32_MAX ){
+                errstr = LAS_ERR_SCANOPT_BUFFER;
+                goto INIT_FAILED;
+            }
+            lscan->qsize = (uint32_t)val;
+        }
+        lua_pop( L, 1 );
+        
         // check appy
         if( apply )
         {
@@ -780,6 +1033,7 @@ static int las_scan_init( lua_State *L, las_scan_t *lscan,
     
     // init
     lscan->as = conn->as;
+    lscan->ctx = ctx;
     lscan->L = L;
     lscan->policy = &ctx->policies.scan;
     lscan->policy_info = &ctx->policies.info;
@@ -795,33 +1049,73 @@ INIT_FAILED:
 }
 
 
-static bool scaneach_cb( const as_val *val, void *udata )
+// bin names: idx...argc
+static int las_scan_select( lua_State *L, las_scan_t *lscan, int idx,
+                            const int argc )
+{
+    const char *binname = NULL;
+    
+    if( argc < idx ){
+        return 0;
+    }
+    else if( !as_scan_select_init( &lscan->scan,
+                                   (uint16_t)( argc - idx + 1 ) ) ){
+        as_scan_destroy( &lscan->scan );
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    // set select bin names
+    for(; idx <= argc; idx++ )
+    {
+        if( !( binname = LAS_CHK_BINNAME( L, idx ) ) ){
+            as_scan_destroy( &lscan->scan );
+            lua_pushnil( L );
+            lua_pushliteral( L, LAS_ERR_BIN_NAME );
+            return 2;
+        }
+        as_scan_select( &lscan->scan, binname );
+    }
+    
+    return 0;
+}
+
+
+// the scan runs on the scanner thread and the records are delivered through
+// the queue, so the client can call back from the node threads concurrently.
+// the scanner is anchored in the iterator userdata that stops the scan on
+// __gc if an error is raised while building the result table.
+// scan all nodes if node is NULL
+static int las_scan_each( lua_State *L, las_scan_t *lscan, const char *node )
 {
-    as_record *rec = as_record_fromval( val );
-    las_scan_t *lscan = (las_scan_t*)udata;
-    lua_State *L = lscan->L;
+    las_scaniter_t *it = las_scaniter_alloc( L, lscan->as, lscan->ctx,
+                                             &lscan->scan, node,
+                                             lscan->qsize );
     
-    if( rec )
+    if( !it ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    lua_newtable( L );
+    while( las_scaniter_pushnext( L, it ) )
     {
-        as_digest *digest = as_key_digest( &rec->key );
-        static const size_t len = AS_DIGEST_VALUE_SIZE * 2;
-        char id[AS_DIGEST_VALUE_SIZE * 2] = {0};
-        
-        digest2hex( (uint8_t*)id, digest->value, AS_DIGEST_VALUE_SIZE );
-        lua_createtable( L, 0, 3 );
-        lstate_strn2tbl( L, "pk", id, len );
-        lstate_num2tbl( L, "ttl", rec->ttl );
-        lstate_num2tbl( L, "gen", rec->gen );
-        if( as_record_numbins( rec ) ){
-            lua_pushstring( L, "bins" );
-            lstate_asrec2tbl( L, rec );
-            lua_rawset( L, -3 );
+        if( node ){
+            lstate_str2tbl( L, "node", node );
         }
-        lua_rawseti( L, -2, ++(lscan->nitem) );
-        return true;
+        lua_rawseti( L, -2, ++lscan->nitem );
     }
     
-    return false;
+    if( it->s.q.rc != AEROSPIKE_OK ){
+        lua_pop( L, 1 );
+        lua_pushnil( L );
+        lua_pushstring( L, it->s.q.err.message );
+        return 2;
+    }
+    
+    return 1;
 }
 
 
@@ -830,58 +1124,127 @@ static int scaneach_lua( lua_State *L )
     const int argc = lua_gettop( L );
     las_scan_t lscan;
     int rv = las_scan_init( L, &lscan, NULL );
-    as_error err;
     
     // got init error
-    if( rv ){
+    if( rv || ( rv = las_scan_select( L, &lscan, 3, argc ) ) ){
         return rv;
     }
-    else if( argc > 2 )
+    
+    return las_scan_each( L, &lscan, NULL );
+}
+
+
+// opt: 2, node name: 3, bin names: 4...N
+// scan the specified node only. the failed node can be retried alone since
+// each record holds the node and partition where it came from.
+static int scannode_lua( lua_State *L )
+{
+    const int argc = lua_gettop( L );
+    const char *node = lstate_checkstring( L, 3 );
+    las_scan_t lscan;
+    int rv = 0;
+    
+    if( !*node || strlen( node ) >= AS_NODE_NAME_SIZE ){
+        return luaL_argerror( L, 3, LAS_ERR_NODE_NAME );
+    }
+    // got init error
+    else if( ( rv = las_scan_init( L, &lscan, NULL ) ) ||
+             ( rv = las_scan_select( L, &lscan, 4, argc ) ) ){
+        return rv;
+    }
+    
+    return las_scan_each( L, &lscan, node );
+}
+
+
+// status of scanForEach
+#define LAS_SCAN_EACH_STOP      1
+#define LAS_SCAN_EACH_ERROR     -1
+
+// opt: 2, fn: 3, bin names: 4...N
+// call fn( record ) with each record; the scan will be aborted if fn
+// returned false
+static int scanforeach_lua( lua_State *L )
+{
+    const int argc = lua_gettop( L );
+    las_scan_t lscan;
+    las_scaniter_t *it = NULL;
+    int rv = 0;
+    int stop = 0;
+    
+    luaL_checktype( L, 3, LUA_TFUNCTION );
+    // got init error
+    if( ( rv = las_scan_init( L, &lscan, NULL ) ) ||
+        ( rv = las_scan_select( L, &lscan, 4, argc ) ) ){
+        return rv;
+    }
+    // scanner will be stopped by __gc if an error is raised
+    else if( !( it = las_scaniter_alloc( L, lscan.as, lscan.ctx, &lscan.scan,
+                                         NULL, lscan.qsize ) ) ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    while( !stop )
     {
-        // bin names: 2...N
-        if( argc < 3 ){
-            as_scan_set_nobins( &lscan.scan, true );
+        lua_pushvalue( L, 3 );
+        if( !las_scaniter_pushnext( L, it ) ){
+            lua_pop( L, 1 );
+            break;
         }
-        else if( !as_scan_select_init( &lscan.scan, (uint16_t)argc - 2 ) ){
-            as_scan_destroy( &lscan.scan );
-            lua_pushnil( L );
-            lua_pushstring( L, strerror( errno ) );
-            return 2;
+        // error message will be left on the stack
+        else if( lua_pcall( L, 1, 1, 0 ) != 0 ){
+            stop = LAS_SCAN_EACH_ERROR;
         }
-        // set select bin names
-        else
-        {
-            int idx = 3;
-            const char *binname = NULL;
-            
-            for(; idx <= argc; idx++ )
-            {
-                if( !( binname = LAS_CHK_BINNAME( L, idx ) ) ){
-                    as_scan_destroy( &lscan.scan );
-                    lua_pushnil( L );
-                    lua_pushliteral( L, LAS_ERR_BIN_NAME );
-                    return 2;
-                }
-                as_scan_select( &lscan.scan, binname );
+        // stop if fn returned false
+        else {
+            if( lua_type( L, -1 ) == LUA_TBOOLEAN && !lua_toboolean( L, -1 ) ){
+                stop = LAS_SCAN_EACH_STOP;
             }
+            lua_pop( L, 1 );
         }
     }
+    // abort the scan if it is not finished
+    las_scanner_join( &it->s );
     
-    
-    lua_newtable( L );
-    if( aerospike_scan_foreach( lscan.as, &err, lscan.policy, &lscan.scan,
-                                scaneach_cb, (void*)&lscan ) != AEROSPIKE_OK ){
-        lua_pop( L, 1 );
+    // got error from fn
+    if( stop == LAS_SCAN_EACH_ERROR ){
         lua_pushnil( L );
-        lua_pushstring( L, err.message );
-        rv = 2;
+        lua_insert( L, -2 );
+        return 2;
     }
-    else {
-        rv = 1;
+    else if( it->s.q.rc != AEROSPIKE_OK ){
+        lua_pushnil( L );
+        lua_pushstring( L, it->s.q.err.message );
+        return 2;
     }
-    as_scan_destroy( &lscan.scan );
+    lua_pushboolean( L, 1 );
     
-    return rv;
+    return 1;
+}
+
+
+// opt: 2, bin names: 3...N
+// returns the iterator that the records are read through the bounded queue
+static int scaniter_lua( lua_State *L )
+{
+    const int argc = lua_gettop( L );
+    las_scan_t lscan;
+    int rv = las_scan_init( L, &lscan, NULL );
+    
+    // got init error
+    if( rv || ( rv = las_scan_select( L, &lscan, 3, argc ) ) ){
+        return rv;
+    }
+    else if( !las_scaniter_alloc( L, lscan.as, lscan.ctx, &lscan.scan, NULL,
+                                  lscan.qsize ) ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    
+    return 1;
 }
 
 
@@ -893,7 +1256,6 @@ static int scanbackground_lua( lua_State *L )
     uint64_t sid = 0;
     as_error err;
     as_status status;
-    as_scan_info info;
     
     // got init error
     if( rv ){
@@ -906,38 +1268,12 @@ static int scanbackground_lua( lua_State *L )
     as_scan_destroy( &lscan.scan );
     // got error
     if( status != AEROSPIKE_OK ){
-        lua_pushboolean( L, 0 );
-        lua_pushstring( L, err.message );
-        return 2;
-    }
-    
-RETRY_SCANINFO:
-    status = aerospike_scan_info( lscan.as, &err, lscan.policy_info, sid, &info );
-    if( status != AEROSPIKE_OK ){
-        lua_pushboolean( L, 0 );
+        lua_pushnil( L );
         lua_pushstring( L, err.message );
         return 2;
     }
     
-    // check scaninfo.status
-    switch( info.status ){
-        // The scan is currently running.
-        case AS_SCAN_STATUS_INPROGRESS:
-            goto RETRY_SCANINFO;
-        
-        // The scan completed successfully.
-        case AS_SCAN_STATUS_COMPLETED:
-            lua_pushboolean( L, 1 );
-            return 1;
-        
-        // The scan was aborted. Due to failure or the user.
-        // AS_SCAN_STATUS_ABORTED
-        // The scan status is undefined.
-        // AS_SCAN_STATUS_UNDEF:
-        default:
-            lua_pushboolean( L, 0 );
-            return 1;
-    }
+    return las_scanjob_alloc( L, lscan.as, lscan.ctx, sid );
 }
 
 
@@ -1044,6 +1380,29 @@ static int infoeach_lua( lua_State *L )
 }
 
 
+// returns the names of the cluster nodes
+static int nodes_lua( lua_State *L )
+{
+    las_conn_t *conn = NULL;
+    int nnode = 0;
+    char *names = NULL;
+    int i = 0;
+    
+    get_context( L, &conn );
+    as_cluster_get_node_names( conn->as->cluster, &nnode, &names );
+    lua_createtable( L, nnode, 0 );
+    for(; i < nnode; i++ ){
+        lua_pushstring( L, names + i * AS_NODE_NAME_SIZE );
+        lua_rawseti( L, -2, i + 1 );
+    }
+    if( names ){
+        pdealloc( names );
+    }
+    
+    return 1;
+}
+
+
 // MARK: index operations
 
 static int indexcreate_lua( lua_State *L )
@@ -1112,6 +1471,8 @@ static int indexremove_lua( lua_State *L )
 typedef struct {
     lua_State *L;
     int nitem;
+    // set if a result could not be decoded
+    int malformed;
 } las_query_t;
 
 static bool query_cb( const as_val *val, void *udata )
@@ -1119,15 +1480,31 @@ static bool query_cb( const as_val *val, void *udata )
     if( val )
     {
         las_query_t *lqry = (las_query_t*)udata;
+        as_record *rec = as_record_fromval( val );
         int idx = lqry->nitem + 1;
+        int rc = 0;
         
         lua_pushnumber( lqry->L, idx );
-        if( lstate_asval2lua( lqry->L, (as_val*)val ) ){
-            lua_rawset( lqry->L, -3 );
-            lqry->nitem = idx;
+        if( rec ){
+            rc = lstate_asrec2tbl( lqry->L, rec ) == -1 ? -1 : 1;
         }
         else {
-            lua_pop( lqry->L, 1 );
+            rc = lstate_asval2lua( lqry->L, (as_val*)val );
+        }
+        
+        switch( rc ){
+            case 1:
+                lua_rawset( lqry->L, -3 );
+                lqry->nitem = idx;
+            break;
+            case 0:
+                lua_pop( lqry->L, 1 );
+            break;
+            // stop the query
+            default:
+                lua_pop( lqry->L, 1 );
+                lqry->malformed = 1;
+                return false;
         }
     }
     
@@ -1143,7 +1520,8 @@ static int query_lua( lua_State *L )
     as_query *qry = lstate_tbl2asqry( L, ctx->ns, ctx->set );
     las_query_t lqry = {
         .L = L,
-        .nitem = 0
+        .nitem = 0,
+        .malformed = 0
     };
     las_apply_args_t apply;
     as_error err;
@@ -1186,12 +1564,19 @@ static int query_lua( lua_State *L )
     
     lua_newtable( L );
     if( aerospike_query_foreach( conn->as, &err, NULL, qry,
-                                 query_cb, (void*)&lqry ) != AEROSPIKE_OK ){
+                                 query_cb, (void*)&lqry ) != AEROSPIKE_OK &&
+        !lqry.malformed ){
         lua_pop( L, 1 );
         lua_pushnil( L );
         lua_pushstring( L, err.message );
         rv++;
     }
+    else if( lqry.malformed ){
+        lua_pop( L, 1 );
+        lua_pushnil( L );
+        lua_pushliteral( L, LAS_ERR_BIN_DECODE );
+        rv++;
+    }
     
     if( argc > 2 ){
         as_arraylist_destroy( &apply.args );
@@ -1203,6 +1588,83 @@ static int query_lua( lua_State *L )
 
 
 
+// opt: { ordered = boolean, bitmap = boolean, chunk = number,
+//        concurrency = number }
+static int las_ctxopt_init( lua_State *L, int idx, las_ctxopt_t *opt )
+{
+    lua_Integer val = 0;
+    
+    memset( opt, 0, sizeof( las_ctxopt_t ) );
+    opt->chunk = LAS_BATCH_CHUNK;
+    opt->concurrency = LAS_WORKER_NTHREAD;
+    if( lua_isnoneornil( L, idx ) ){
+        return 0;
+    }
+    luaL_checktype( L, idx, LUA_TTABLE );
+    
+    // check ordered
+    lua_pushstring( L, "ordered" );
+    lua_rawget( L, idx );
+    if( !lua_isnoneornil( L, -1 ) )
+    {
+        if( lua_type( L, -1 ) != LUA_TBOOLEAN ){
+            lua_pushnil( L );
+            lua_pushliteral( L, LAS_ERR_CTXOPT_ORDERED );
+            return -1;
+        }
+        opt->ordered = lua_toboolean( L, -1 );
+    }
+    lua_pop( L, 1 );
+    
+    // check bitmap
+    lua_pushstring( L, "bitmap" );
+    lua_rawget( L, idx );
+    if( !lua_isnoneornil( L, -1 ) )
+    {
+        if( lua_type( L, -1 ) != LUA_TBOOLEAN ){
+            lua_pushnil( L );
+            lua_pushliteral( L, LAS_ERR_CTXOPT_BITMAP );
+            return -1;
+        }
+        opt->bitmap = lua_toboolean( L, -1 );
+    }
+    lua_pop( L, 1 );
+    
+    // check chunk
+    lua_pushstring( L, "chunk" );
+    lua_rawget( L, idx );
+    if( !lua_isnoneornil( L, -1 ) )
+    {
+        if( lua_type( L, -1 ) != LUA_TNUMBER ||
+            ( val = lua_tointeger( L, -1 ) ) < 0 || val > UINT32_MAX ){
+            lua_pushnil( L );
+            lua_pushliteral( L, LAS_ERR_CTXOPT_CHUNK );
+            return -1;
+        }
+        opt->chunk = (uint32_t)val;
+    }
+    lua_pop( L, 1 );
+    
+    // check concurrency
+    lua_pushstring( L, "concurrency" );
+    lua_rawget( L, idx );
+    if( !lua_isnoneornil( L, -1 ) )
+    {
+        if( lua_type( L, -1 ) != LUA_TNUMBER ||
+            ( val = lua_tointeger( L, -1 ) ) < 1 ||
+            val > LAS_WORKER_NTHREAD_MAX ){
+            lua_pushnil( L );
+            lua_pushliteral( L, LAS_ERR_CTXOPT_CONCURRENCY );
+            return -1;
+        }
+        opt->concurrency = (uint32_t)val;
+    }
+    lua_pop( L, 1 );
+    
+    return 0;
+}
+
+
 int las_ctx_alloc_lua( lua_State *L )
 {
     las_ctx_t *ctx = NULL;
@@ -1212,6 +1674,7 @@ int las_ctx_alloc_lua( lua_State *L )
     // set(like table)
     size_t nsset_len = 0;
     const char *nsset = NULL;
+    las_ctxopt_t opt;
     
     // check arguments
     luaL_checkudata( L, 1, LAS_CONNECTION_MT );
@@ -1221,8 +1684,11 @@ int las_ctx_alloc_lua( lua_State *L )
     if( !lua_isnoneornil( L, 3 ) ){
         nsset = lstate_checklstring( L, 3, &nsset_len );
     }
-    
-    if( ns_len >= AS_NAMESPACE_MAX_SIZE ){
+    // check options
+    if( las_ctxopt_init( L, 4, &opt ) != 0 ){
+        return 2;
+    }
+    else if( ns_len >= AS_NAMESPACE_MAX_SIZE ){
         lua_pushnil( L );
         lua_pushliteral( L, LAS_ERR_NAMESPACE );
     }
@@ -1233,7 +1699,15 @@ int las_ctx_alloc_lua( lua_State *L )
     else if( ( ctx = lua_newuserdata( L, sizeof( las_ctx_t ) ) ) )
     {
         ctx->ref_conn = lstate_ref( L, 1 );
+        lua_newtable( L );
+        ctx->ref_pool = lstate_ref( L, -1 );
+        lua_pop( L, 1 );
+        las_mpack_init( &ctx->mpack );
         as_policies_init( &ctx->policies );
+        ctx->opt = opt;
+        // map and list bins will be decoded from msgpack directly
+        ctx->policies.read.deserialize = false;
+        ctx->policies.batch.deserialize = false;
         // copy string+null-terminator
         memcpy( (void*)ctx->ns, ns, ns_len + 1 );
         // set can be null
@@ -1258,6 +1732,8 @@ static int gc_lua( lua_State *L )
     
     // release las_conn_t reference
     lstate_unref( L, ctx->ref_conn );
+    lstate_unref( L, ctx->ref_pool );
+    las_mpack_dispose( &ctx->mpack );
 
     return 0;
 }
@@ -1280,19 +1756,31 @@ void las_ctx_init( lua_State *L )
         { "put", put_lua },
         { "get", get_lua },
         { "select", select_lua },
+        { "getRecord", getrecord_lua },
         { "exists", exists_lua },
         { "remove", remove_lua },
         { "operate", operate_lua },
         { "apply", apply_lua },
         // batch ops
         { "batchGet", batchget_lua },
+        { "batchSelect", batchselect_lua },
         { "batchExists", batchexists_lua },
+        { "batchEach", batcheach_lua },
+        { "batchPut", batchput_lua },
+        { "batchRemove", batchremove_lua },
+        { "batchTouch", batchtouch_lua },
+        { "batchOperate", batchoperate_lua },
+        { "batchApply", batchapply_lua },
         // scan ops
         { "scanBackground", scanbackground_lua },
         { "scanEach", scaneach_lua },
+        { "scanIter", scaniter_lua },
+        { "scanForEach", scanforeach_lua },
+        { "scanNode", scannode_lua },
         // info ops
         { "info", info_lua },
         { "infoEach", infoeach_lua },
+        { "nodes", nodes_lua },
         // index ops
         { "indexCreate", indexcreate_lua },
         { "indexRemove", indexremove_lua },
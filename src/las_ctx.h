@@ -32,15 +32,38 @@
 
 #include "las.h"
 #include "las_connect.h"
+#include "las_mpack.h"
 
 #define LAS_IDX_INTEGER 1
 #define LAS_IDX_STRING  2
 
+// default number of keys of a batch request
+#define LAS_BATCH_CHUNK 5000
+
+// options of context
+typedef struct {
+    // batch results will be returned as array in order of keys
+    int ordered;
+    // batchExists returns the bitmap string that bit i is set if key i
+    // exists
+    int bitmap;
+    // batch keys will be split into the chunks of this number of keys.
+    // 0 disables the splitting.
+    uint32_t chunk;
+    // number of threads that the chunks are dispatched to
+    uint32_t concurrency;
+} las_ctxopt_t;
+
 typedef struct {
     const char ns[AS_NAMESPACE_MAX_SIZE];
     const char set[AS_SET_MAX_SIZE];
     as_policies policies;
+    las_ctxopt_t opt;
     int ref_conn;
+    // record tables to be reused by batch operations
+    int ref_pool;
+    // buffer for the encoded bin values
+    las_mpack_t mpack;
 } las_ctx_t;
 
 void las_ctx_init( lua_State *L );
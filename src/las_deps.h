@@ -56,6 +56,7 @@
 #include <aerospike/as_query.h>
 // primitives
 #include <aerospike/as_node.h>
+#include <aerospike/as_cluster.h>
 #include <aerospike/as_boolean.h>
 #include <aerospike/as_status.h>
 #include <aerospike/as_error.h>
@@ -76,6 +77,24 @@
 #define LAS_ERR_RECORD_TYPE \
     "record must be type of table"
 
+#define LAS_ERR_TABLE_MIXED \
+    "should not be included both of array and hash"
+
+#define LAS_ERR_TABLE_SPARSE \
+    "array must be a sequence without holes"
+
+#define LAS_ERR_BIN_DECODE \
+    "bin value could not be decoded"
+
+#define LAS_ERR_PK \
+    "pk must be type of string, number or aerospike.key"
+
+#define LAS_ERR_PK_CONTEXT \
+    "aerospike.key must belong to the namespace and set of context"
+
+#define LAS_ERR_PK_DIGEST \
+    "digest must be 20 bytes binary or 40 characters hex string"
+
 #define LAS_ERR_BIN_NAME \
     "bin name must be type of string and length must be 1 to " STRINGIZE(AS_BIN_NAME_MAX_SIZE)
 
@@ -99,6 +118,20 @@
     "UDF argument does not support "
 
 
+// context option errors
+#define LAS_ERR_CTXOPT_ORDERED \
+    "opt.ordered must be type of boolean"
+
+#define LAS_ERR_CTXOPT_BITMAP \
+    "opt.bitmap must be type of boolean"
+
+#define LAS_ERR_CTXOPT_CHUNK \
+    "opt.chunk must be 0 to 4294967295"
+
+#define LAS_ERR_CTXOPT_CONCURRENCY \
+    "opt.concurrency must be 1 to 64"
+
+
 // scan option errors
 #define LAS_ERR_SCANOPT_PRIORITY \
     "opt.priority must be SCAN_PRIORITY_<AUTO|LOW|MEDIUM|HIGH>"
@@ -109,6 +142,15 @@
 #define LAS_ERR_SCANOPT_CONCURRENT \
     "opt.concurrent must be type of boolean"
 
+#define LAS_ERR_SCANOPT_BUFFER \
+    "opt.buffer must be 1 to 4294967295"
+
+#define LAS_ERR_NODE_NAME \
+    "node name must be 1 to 19 characters"
+
+#define LAS_ERR_SCANJOB_TIMEOUT \
+    "timeout must be greater than or equal to 0"
+
 #define LAS_ERR_SCANOPT_APPLY \
     "opt.apply must be type of table"
 
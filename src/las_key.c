@@ -0,0 +1,349 @@
+/*
+ *  Copyright 2014 Masatoshi Teruya. All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  las_key.c
+ *  lua-aerospike
+ *
+ *  Created by Masatoshi Teruya on 2014/09/10.
+ *
+ */
+
+#include "las_key.h"
+#include "las_ctx.h"
+
+
+// integer key must be an integral number in the range of int64_t.
+// range is checked first since the cast of NaN, inf or out of range number
+// is undefined.
+static inline int las_pk_isint( lua_Number num )
+{
+    return num >= -9223372036854775808.0 && num < 9223372036854775808.0 &&
+           (lua_Number)(int64_t)num == num;
+}
+
+
+// returns NULL if number is not an integer key
+static inline as_key *las_pk_init_num( lua_State *L, int idx, const char *ns,
+                                       const char *set, as_key *key )
+{
+    lua_Number num = lua_tonumber( L, idx );
+    
+    if( !las_pk_isint( num ) ){
+        return NULL;
+    }
+    
+    return as_key_init_int64( key, ns, set, (int64_t)num );
+}
+
+
+// prepared key must be created by the context of same namespace and set
+static inline las_pk_t *las_pk_toctx( lua_State *L, int idx, const char *ns,
+                                      const char *set )
+{
+    las_pk_t *pk = lstate_toudata( L, idx, LAS_KEY_MT );
+    
+    if( pk && ( strcmp( pk->key.ns, ns ) != 0 ||
+                strcmp( pk->key.set, set ) != 0 ) ){
+        return NULL;
+    }
+    
+    return pk;
+}
+
+
+/**
+ * returns the as_key of primary key at idx.
+ * string and integer primary key will be initialized into the key argument,
+ * and string key refers to the lua string value. returns NULL if pk is not
+ * supported type or prepared key belongs to other namespace or set.
+ */
+as_key *las_pk_check( lua_State *L, int idx, const char *ns, const char *set,
+                      as_key *key )
+{
+    las_pk_t *pk = NULL;
+    
+    switch( lua_type( L, idx ) ){
+        case LUA_TSTRING:
+            return as_key_init( key, ns, set, lua_tostring( L, idx ) );
+        case LUA_TNUMBER:
+            return las_pk_init_num( L, idx, ns, set, key );
+        case LUA_TUSERDATA:
+            if( ( pk = las_pk_toctx( L, idx, ns, set ) ) ){
+                return &pk->key;
+            }
+        break;
+    }
+    
+    return NULL;
+}
+
+
+/**
+ * initialize the key argument by primary key at idx.
+ * prepared key will be copied with its digest. returns NULL if pk is not
+ * supported type or prepared key belongs to other namespace or set.
+ */
+as_key *las_pk_init( lua_State *L, int idx, const char *ns, const char *set,
+                     as_key *key )
+{
+    las_pk_t *pk = NULL;
+    
+    switch( lua_type( L, idx ) ){
+        case LUA_TSTRING:
+            return as_key_init( key, ns, set, lua_tostring( L, idx ) );
+        case LUA_TNUMBER:
+            return las_pk_init_num( L, idx, ns, set, key );
+        case LUA_TUSERDATA:
+            if( ( pk = las_pk_toctx( L, idx, ns, set ) ) )
+            {
+                // value of the copy refers to the prepared key memory
+                memcpy( key, &pk->key, sizeof( as_key ) );
+                if( pk->key.valuep ){
+                    key->valuep = &key->value;
+                }
+                return key;
+            }
+        break;
+    }
+    
+    return NULL;
+}
+
+
+/**
+ * returns the reason why las_pk_check or las_pk_init failed for the pk at idx.
+ */
+const char *las_pk_strerror( lua_State *L, int idx )
+{
+    if( lstate_toudata( L, idx, LAS_KEY_MT ) ){
+        return LAS_ERR_PK_CONTEXT;
+    }
+    
+    return LAS_ERR_PK;
+}
+
+
+/**
+ * push the primary key value, or the hex string of digest if the key does
+ * not have a value.
+ */
+void las_pk_push( lua_State *L, const as_key *key )
+{
+    as_val *val = (as_val*)key->valuep;
+    
+    switch( val ? as_val_type( val ) : AS_UNDEF ){
+        case AS_STRING:
+            lua_pushstring( L, as_string_get( (as_string*)val ) );
+        break;
+        case AS_INTEGER:
+            lua_pushinteger( L, as_integer_get( (as_integer*)val ) );
+        break;
+        case AS_BYTES:
+            lua_pushlstring( L, (char*)as_bytes_get( (as_bytes*)val ),
+                             as_bytes_size( (as_bytes*)val ) );
+        break;
+        
+        // digest only
+        default:
+        {
+            char hex[AS_DIGEST_VALUE_SIZE * 2] = {0};
+            
+            digest2hex( (uint8_t*)hex, (uint8_t*)key->digest.value,
+                        AS_DIGEST_VALUE_SIZE );
+            lua_pushlstring( L, hex, AS_DIGEST_VALUE_SIZE * 2 );
+        }
+    }
+}
+
+
+static int tostring_lua( lua_State *L )
+{
+    return TOSTRING_MT( L, LAS_KEY_MT );
+}
+
+
+static int gc_lua( lua_State *L )
+{
+    las_pk_t *pk = (las_pk_t*)lua_touserdata( L, 1 );
+    
+    as_key_destroy( &pk->key );
+    
+    return 0;
+}
+
+
+static las_pk_t *set_str2pk( lua_State *L, las_ctx_t *ctx )
+{
+    size_t len = 0;
+    const char *str = lstate_checklstring( L, 2, &len );
+    las_pk_t *pk = lua_newuserdata( L, sizeof( las_pk_t ) + len + 1 );
+    
+    if( pk )
+    {
+        char *val = (char*)( pk + 1 );
+        
+        // copy string+null-terminator
+        memcpy( val, str, len + 1 );
+        as_key_init_strp( &pk->key, ctx->ns, ctx->set, val, false );
+        // calculate digest
+        as_key_digest( &pk->key );
+    }
+    
+    return pk;
+}
+
+
+static las_pk_t *set_int2pk( lua_State *L, las_ctx_t *ctx )
+{
+    lua_Number val = lstate_checknumber( L, 2 );
+    las_pk_t *pk = NULL;
+    
+    if( !las_pk_isint( val ) ){
+        luaL_argerror( L, 2, LAS_ERR_PK );
+    }
+    else if( ( pk = lua_newuserdata( L, sizeof( las_pk_t ) ) ) ){
+        as_key_init_int64( &pk->key, ctx->ns, ctx->set, (int64_t)val );
+        // calculate digest
+        as_key_digest( &pk->key );
+    }
+    
+    return pk;
+}
+
+
+static las_pk_t *set_bytes2pk( lua_State *L, las_ctx_t *ctx )
+{
+    size_t len = 0;
+    const char *str = lstate_checklstring( L, 2, &len );
+    las_pk_t *pk = NULL;
+    
+    if( len > UINT32_MAX ){
+        luaL_argerror( L, 2, "pk length must be less than " STRINGIZE(UINT32_MAX) );
+        return NULL;
+    }
+    else if( ( pk = lua_newuserdata( L, sizeof( las_pk_t ) + len ) ) )
+    {
+        uint8_t *val = (uint8_t*)( pk + 1 );
+        
+        memcpy( val, str, len );
+        as_key_init_rawp( &pk->key, ctx->ns, ctx->set, val, (uint32_t)len,
+                          false );
+        // calculate digest
+        as_key_digest( &pk->key );
+    }
+    
+    return pk;
+}
+
+
+static las_pk_t *set_digest2pk( lua_State *L, las_ctx_t *ctx )
+{
+    size_t len = 0;
+    const char *str = lstate_checklstring( L, 2, &len );
+    as_digest_value digest;
+    las_pk_t *pk = NULL;
+    
+    // raw digest
+    if( len == AS_DIGEST_VALUE_SIZE ){
+        memcpy( digest, str, AS_DIGEST_VALUE_SIZE );
+    }
+    // hex string of digest
+    else if( len != AS_DIGEST_VALUE_SIZE * 2 ||
+             hex2digest( digest, (const uint8_t*)str,
+                         AS_DIGEST_VALUE_SIZE ) != 0 ){
+        luaL_argerror( L, 2, LAS_ERR_PK_DIGEST );
+        return NULL;
+    }
+    
+    if( ( pk = lua_newuserdata( L, sizeof( las_pk_t ) ) ) ){
+        as_key_init_digest( &pk->key, ctx->ns, ctx->set, digest );
+    }
+    
+    return pk;
+}
+
+
+static int alloc_lua( lua_State *L )
+{
+    las_ctx_t *ctx = luaL_checkudata( L, 1, LAS_CONTEXT_MT );
+    lua_Integer type = LAS_KEY_STRING;
+    las_pk_t *pk = NULL;
+    
+    // check type
+    if( !lua_isnoneornil( L, 3 ) ){
+        type = lstate_checkinteger( L, 3 );
+    }
+    // number pk is integer key by default
+    else if( lua_type( L, 2 ) == LUA_TNUMBER ){
+        type = LAS_KEY_INTEGER;
+    }
+    
+    switch( type ){
+        case LAS_KEY_STRING:
+            pk = set_str2pk( L, ctx );
+        break;
+        case LAS_KEY_INTEGER:
+            pk = set_int2pk( L, ctx );
+        break;
+        case LAS_KEY_BYTES:
+            pk = set_bytes2pk( L, ctx );
+        break;
+        case LAS_KEY_DIGEST:
+            pk = set_digest2pk( L, ctx );
+        break;
+        default:
+            return luaL_argerror( L, 3,
+                "key type must be KEY_<STRING|INTEGER|BYTES|DIGEST>"
+            );
+    }
+    
+    if( pk ){
+        lstate_setmetatable( L, LAS_KEY_MT );
+        return 1;
+    }
+    
+    // mem error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+    
+    return 2;
+}
+
+
+LUALIB_API int luaopen_aerospike_key( lua_State *L )
+{
+    struct luaL_Reg mmethod[] = {
+        { "__gc", gc_lua },
+        { "__tostring", tostring_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg method[] = {
+        { NULL, NULL }
+    };
+    
+    lstate_definemt( L, LAS_KEY_MT, mmethod, method );
+    // add methods
+    lua_pushcfunction( L, alloc_lua );
+    
+    return 1;
+}
+
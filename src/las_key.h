@@ -0,0 +1,60 @@
+/*
+ *  Copyright 2014 Masatoshi Teruya. All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  las_key.h
+ *  lua-aerospike
+ *
+ *  Created by Masatoshi Teruya on 2014/09/10.
+ *
+ */
+
+#ifndef lua_aerospike_las_key_h
+#define lua_aerospike_las_key_h
+
+#include "las.h"
+
+// types of primary key
+#define LAS_KEY_STRING  1
+#define LAS_KEY_DIGEST  2
+#define LAS_KEY_INTEGER 3
+#define LAS_KEY_BYTES   4
+
+// prepared key: digest is calculated at once when it is created.
+// it holds a namespace and set of the context that created it.
+typedef struct {
+    as_key key;
+    // followed by the copy of primary key
+} las_pk_t;
+
+
+// prototypes
+LUALIB_API int luaopen_aerospike_key( lua_State *L );
+
+as_key *las_pk_check( lua_State *L, int idx, const char *ns, const char *set,
+                      as_key *key );
+as_key *las_pk_init( lua_State *L, int idx, const char *ns, const char *set,
+                     as_key *key );
+const char *las_pk_strerror( lua_State *L, int idx );
+void las_pk_push( lua_State *L, const as_key *key );
+
+
+#endif
@@ -0,0 +1,1071 @@
+/*
+ *  Copyright 2014 Masatoshi Teruya. All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  las_mpack.c
+ *  lua-aerospike
+ *
+ *  Created by Masatoshi Teruya on 2014/09/12.
+ *
+ */
+
+#include "las_mpack.h"
+
+
+// MARK: buffer
+static int mpack_reserve( las_mpack_t *mp, size_t n )
+{
+    if( mp->size - mp->len < n )
+    {
+        size_t size = mp->size ? mp->size : LAS_MPACK_BUFSIZE;
+        uint8_t *data = NULL;
+        
+        while( size - mp->len < n ){
+            size *= 2;
+        }
+        if( !( data = realloc( mp->data, size ) ) ){
+            return -1;
+        }
+        mp->data = data;
+        mp->size = size;
+    }
+    
+    return 0;
+}
+
+#define mpack_put8( mp, v ) \
+    ((mp)->data[(mp)->len++] = (uint8_t)(v))
+
+#define mpack_put16( mp, v ) do { \
+    uint16_t _v = (uint16_t)(v); \
+    mpack_put8( mp, _v >> 8 ); \
+    mpack_put8( mp, _v ); \
+}while(0)
+
+#define mpack_put32( mp, v ) do { \
+    uint32_t _v32 = (uint32_t)(v); \
+    mpack_put16( mp, _v32 >> 16 ); \
+    mpack_put16( mp, _v32 ); \
+}while(0)
+
+#define mpack_put64( mp, v ) do { \
+    uint64_t _v64 = (uint64_t)(v); \
+    mpack_put32( mp, _v64 >> 32 ); \
+    mpack_put32( mp, _v64 ); \
+}while(0)
+
+
+// MARK: encode lua value to msgpack
+// smallest representation of integer; max 9 bytes
+static void mpack_int( las_mpack_t *mp, int64_t v )
+{
+    if( v < -32 )
+    {
+        if( v < INT32_MIN ){
+            mpack_put8( mp, 0xd3 );
+            mpack_put64( mp, v );
+        }
+        else if( v < INT16_MIN ){
+            mpack_put8( mp, 0xd2 );
+            mpack_put32( mp, v );
+        }
+        else if( v < INT8_MIN ){
+            mpack_put8( mp, 0xd1 );
+            mpack_put16( mp, v );
+        }
+        else {
+            mpack_put8( mp, 0xd0 );
+            mpack_put8( mp, v );
+        }
+    }
+    // negative fixnum and positive fixnum
+    else if( v < 128 ){
+        mpack_put8( mp, v );
+    }
+    else if( v < 256 ){
+        mpack_put8( mp, 0xcc );
+        mpack_put8( mp, v );
+    }
+    else if( v < 65536 ){
+        mpack_put8( mp, 0xcd );
+        mpack_put16( mp, v );
+    }
+    else if( v <= UINT32_MAX ){
+        mpack_put8( mp, 0xce );
+        mpack_put32( mp, v );
+    }
+    else {
+        mpack_put8( mp, 0xcf );
+        mpack_put64( mp, v );
+    }
+}
+
+
+// aerospike string is the raw bytes prefixed by AS_BYTES_STRING
+static int mpack_str( las_mpack_t *mp, const char *str, size_t len )
+{
+    size_t size = len + 1;
+    
+    if( mpack_reserve( mp, size + 5 ) != 0 ){
+        return -1;
+    }
+    else if( size < 32 ){
+        mpack_put8( mp, 0xa0 | size );
+    }
+    else if( size < 65536 ){
+        mpack_put8( mp, 0xda );
+        mpack_put16( mp, size );
+    }
+    else {
+        mpack_put8( mp, 0xdb );
+        mpack_put32( mp, size );
+    }
+    mpack_put8( mp, AS_BYTES_STRING );
+    memcpy( mp->data + mp->len, str, len );
+    mp->len += len;
+    
+    return 0;
+}
+
+
+// size of map or array header
+#define mpack_hlen( n ) \
+    ((n) < 16 ? 1 : (n) < 65536 ? 3 : 5)
+
+// write the header of n items at pos that has hlen bytes space.
+// map: 0x80, 0xde, 0xdf / array: 0x90, 0xdc, 0xdd
+static int mpack_header( las_mpack_t *mp, size_t pos, size_t hlen, int type,
+                         size_t n )
+{
+    size_t need = mpack_hlen( n );
+    size_t len = 0;
+    uint8_t fix = type == LUA_TTABLE_HASH ? 0x80 : 0x90;
+    uint8_t type16 = type == LUA_TTABLE_HASH ? 0xde : 0xdc;
+    
+    // move the items behind the header
+    if( need != hlen )
+    {
+        if( need > hlen && mpack_reserve( mp, need - hlen ) != 0 ){
+            return -1;
+        }
+        memmove( mp->data + pos + need, mp->data + pos + hlen,
+                 mp->len - pos - hlen );
+        mp->len = mp->len + need - hlen;
+    }
+    
+    len = mp->len;
+    mp->len = pos;
+    if( n < 16 ){
+        mpack_put8( mp, fix | n );
+    }
+    else if( n < 65536 ){
+        mpack_put8( mp, type16 );
+        mpack_put16( mp, n );
+    }
+    else {
+        mpack_put8( mp, type16 + 1 );
+        mpack_put32( mp, n );
+    }
+    mp->len = len;
+    
+    return 0;
+}
+
+
+static int mpack_tbl( lua_State *L, las_mpack_t *mp );
+
+// value at the top of stack.
+// returns 1 if nothing is written for an empty table
+static int mpack_val( lua_State *L, las_mpack_t *mp )
+{
+    size_t len = 0;
+    const char *str = NULL;
+    
+    switch( lua_type( L, -1 ) ){
+        case LUA_TSTRING:
+            str = lua_tolstring( L, -1, &len );
+            return mpack_str( mp, str, len );
+        case LUA_TNUMBER:
+            if( mpack_reserve( mp, 9 ) != 0 ){
+                return -1;
+            }
+            mpack_int( mp, lua_tointeger( L, -1 ) );
+            return 0;
+        case LUA_TBOOLEAN:
+            if( mpack_reserve( mp, 1 ) != 0 ){
+                return -1;
+            }
+            mpack_int( mp, lua_toboolean( L, -1 ) );
+            return 0;
+        case LUA_TTABLE:
+            switch( mpack_tbl( L, mp ) ){
+                case -1:
+                    return -1;
+                case LUA_TTABLE_EMPTY:
+                    return 1;
+            }
+            return 0;
+    }
+    
+    // unsupported data type
+    return -2;
+}
+
+
+// push the error of the table that is not a sequence
+static int mpack_seqerr( lua_State *L )
+{
+    size_t len = 0;
+    
+    lua_pushboolean( L, 0 );
+    if( lstate_tablelen( L, &len ) == LUA_TTABLE_LIST ){
+        lua_pushliteral( L, LAS_ERR_TABLE_SPARSE );
+    }
+    else {
+        lua_pushliteral( L, LAS_ERR_TABLE_MIXED );
+    }
+    
+    return -1;
+}
+
+
+// list item at the top of stack.
+// empty table is encoded as nil, and the trailing empty tables are dropped
+// as the as_arraylist does; nitem and tail are the number of items and
+// the end of the last item that is not an empty table.
+static int mpack_item( lua_State *L, las_mpack_t *mp, size_t idx,
+                       size_t *nitem, size_t *tail )
+{
+    switch( mpack_val( L, mp ) ){
+        case -1:
+            lua_pushboolean( L, 0 );
+            lua_pushstring( L, strerror( errno ) );
+            return -1;
+        // unsupported data type
+        case -2:
+            lua_pushboolean( L, 0 );
+            lua_pushfstring( L, "unsupported data type %s at index %d",
+                             lua_typename( L, lua_type( L, -2 ) ),
+                             (int)idx - 1 );
+            return -1;
+        // empty table
+        case 1:
+            if( mpack_reserve( mp, 1 ) != 0 ){
+                lua_pushboolean( L, 0 );
+                lua_pushstring( L, strerror( errno ) );
+                return -1;
+            }
+            mpack_put8( mp, 0xc0 );
+        break;
+        default:
+            *nitem = idx;
+            *tail = mp->len;
+    }
+    
+    return 0;
+}
+
+
+// encode the sequence that lua_next does not traverse in order of keys,
+// e.g. the items are stored in the hash part. keys are checked by
+// lstate_seqlen and the items are read by lua_rawgeti.
+// returns LUA_TTABLE_LIST or -1 on error
+static int mpack_seq( lua_State *L, las_mpack_t *mp )
+{
+    size_t len = lstate_seqlen( L );
+    size_t hlen = mpack_hlen( len );
+    size_t pos = mp->len;
+    size_t idx = 1;
+    size_t nitem = 0;
+    size_t tail = 0;
+    
+    if( !len ){
+        return mpack_seqerr( L );
+    }
+    // reserve header space
+    else if( mpack_reserve( mp, hlen ) != 0 ){
+        goto MEM_ERROR;
+    }
+    mp->len += hlen;
+    tail = mp->len;
+    
+    for(; idx <= len; idx++ )
+    {
+        lua_rawgeti( L, -1, (int)idx );
+        if( mpack_item( L, mp, idx, &nitem, &tail ) != 0 ){
+            return -1;
+        }
+        lua_pop( L, 1 );
+    }
+    
+    mp->len = tail;
+    if( mpack_header( mp, pos, hlen, LUA_TTABLE_LIST, nitem ) == 0 ){
+        return LUA_TTABLE_LIST;
+    }
+    
+MEM_ERROR:
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+    return -1;
+}
+
+
+// table is classified by the first key and encoded in the same traversal.
+// header space is sized by lua_objlen and the items are moved once if the
+// final number of items needs another size.
+// items of the list are encoded as they are traversed while the keys are
+// 1, 2, 3...; it falls back to mpack_seq if a key is out of order.
+// the field of empty table is not encoded.
+// returns type of table or -1 on error
+static int mpack_tbl( lua_State *L, las_mpack_t *mp )
+{
+    int type = LUA_TTABLE_EMPTY;
+    size_t hlen = mpack_hlen( lua_objlen( L, -1 ) );
+    size_t pos = mp->len;
+    // number of keys traversed
+    size_t nkey = 0;
+    size_t nitem = 0;
+    size_t tail = 0;
+    size_t kpos = 0;
+    size_t len = 0;
+    const char *str = NULL;
+    
+    // reserve header space
+    if( mpack_reserve( mp, hlen ) != 0 ){
+        goto MEM_ERROR;
+    }
+    mp->len += hlen;
+    tail = mp->len;
+    
+    // push space
+    lua_pushnil( L );
+    // key: -2, val: -1
+    while( lua_next( L, -2 ) )
+    {
+        nkey++;
+        switch( lua_type( L, -2 ) )
+        {
+            case LUA_TNUMBER:
+                if( type == LUA_TTABLE_HASH ){
+                    goto MIXED_ERROR;
+                }
+                type = LUA_TTABLE_LIST;
+                // key is out of order
+                if( lua_tonumber( L, -2 ) != (lua_Number)nkey ){
+                    lua_pop( L, 2 );
+                    mp->len = pos;
+                    return mpack_seq( L, mp );
+                }
+                else if( mpack_item( L, mp, nkey, &nitem, &tail ) != 0 ){
+                    return -1;
+                }
+            break;
+            
+            case LUA_TSTRING:
+                if( type == LUA_TTABLE_LIST ){
+                    goto MIXED_ERROR;
+                }
+                type = LUA_TTABLE_HASH;
+                kpos = mp->len;
+                str = lua_tolstring( L, -2, &len );
+                if( mpack_str( mp, str, len ) != 0 ){
+                    goto MEM_ERROR;
+                }
+                switch( mpack_val( L, mp ) ){
+                    case -1:
+                        goto MEM_ERROR;
+                    // unsupported data type
+                    case -2:
+                        lua_pushboolean( L, 0 );
+                        lua_pushfstring( L, "unsupported data type %s at field %s",
+                                         lua_typename( L, lua_type( L, -2 ) ),
+                                         lua_tostring( L, -3 ) );
+                        return -1;
+                    // drop the field of empty table
+                    case 1:
+                        mp->len = kpos;
+                    break;
+                    default:
+                        nitem++;
+                }
+            break;
+            
+            default:
+                goto MIXED_ERROR;
+        }
+        lua_pop( L, 1 );
+    }
+    
+    switch( type ){
+        // empty table is not encoded
+        case LUA_TTABLE_EMPTY:
+            mp->len = pos;
+            return LUA_TTABLE_EMPTY;
+        case LUA_TTABLE_LIST:
+            mp->len = tail;
+        break;
+    }
+    
+    if( mpack_header( mp, pos, hlen, type, nitem ) == 0 ){
+        return type;
+    }
+    
+MEM_ERROR:
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+    return -1;
+
+MIXED_ERROR:
+    lua_pushboolean( L, 0 );
+    lua_pushliteral( L, LAS_ERR_TABLE_MIXED );
+    return -1;
+}
+
+
+// MARK: encode as_val to msgpack
+static int mpack_asval( las_mpack_t *mp, const as_val *val );
+
+static int mpack_asmap( las_mpack_t *mp, const as_hashmap *map )
+{
+    as_pair *pair = NULL;
+    as_hashmap_iterator it;
+    int rc = mpack_reserve( mp, 5 );
+    
+    if( rc == 0 )
+    {
+        size_t pos = mp->len;
+        
+        mp->len += 5;
+        rc = mpack_header( mp, pos, 5, LUA_TTABLE_HASH,
+                           as_hashmap_size( map ) );
+        as_hashmap_iterator_init( &it, map );
+        while( rc == 0 && as_hashmap_iterator_has_next( &it ) ){
+            pair = (as_pair*)as_hashmap_iterator_next( &it );
+            if( ( rc = mpack_asval( mp, as_pair_1( pair ) ) ) == 0 ){
+                rc = mpack_asval( mp, as_pair_2( pair ) );
+            }
+        }
+        as_hashmap_iterator_destroy( &it );
+    }
+    
+    return rc;
+}
+
+
+static int mpack_asarr( las_mpack_t *mp, const as_arraylist *arr )
+{
+    as_arraylist_iterator it;
+    int rc = mpack_reserve( mp, 5 );
+    
+    if( rc == 0 )
+    {
+        size_t pos = mp->len;
+        
+        mp->len += 5;
+        rc = mpack_header( mp, pos, 5, LUA_TTABLE_LIST,
+                           as_arraylist_size( arr ) );
+        as_arraylist_iterator_init( &it, arr );
+        while( rc == 0 && as_arraylist_iterator_has_next( &it ) ){
+            rc = mpack_asval( mp, as_arraylist_iterator_next( &it ) );
+        }
+        as_arraylist_iterator_destroy( &it );
+    }
+    
+    return rc;
+}
+
+
+static int mpack_asval( las_mpack_t *mp, const as_val *val )
+{
+    as_bytes *bytes = NULL;
+    size_t len = 0;
+    
+    switch( as_val_type( val ) )
+    {
+        case AS_BOOLEAN:
+            if( mpack_reserve( mp, 1 ) != 0 ){
+                return -1;
+            }
+            mpack_put8( mp, as_boolean_get( (as_boolean*)val ) ? 0xc3 : 0xc2 );
+            return 0;
+        case AS_INTEGER:
+            if( mpack_reserve( mp, 9 ) != 0 ){
+                return -1;
+            }
+            mpack_int( mp, as_integer_get( (as_integer*)val ) );
+            return 0;
+        case AS_STRING:
+            return mpack_str( mp, as_string_get( (as_string*)val ),
+                              as_string_len( (as_string*)val ) );
+        case AS_BYTES:
+            bytes = (as_bytes*)val;
+            len = as_bytes_size( bytes );
+            switch( as_bytes_get_type( bytes ) ){
+                // already encoded
+                case AS_BYTES_MAP:
+                case AS_BYTES_LIST:
+                    if( mpack_reserve( mp, len ) != 0 ){
+                        return -1;
+                    }
+                break;
+                // raw bytes prefixed by the particle type
+                default:
+                    if( mpack_reserve( mp, len + 6 ) != 0 ){
+                        return -1;
+                    }
+                    else if( len + 1 < 32 ){
+                        mpack_put8( mp, 0xa0 | ( len + 1 ) );
+                    }
+                    else if( len + 1 < 65536 ){
+                        mpack_put8( mp, 0xda );
+                        mpack_put16( mp, len + 1 );
+                    }
+                    else {
+                        mpack_put8( mp, 0xdb );
+                        mpack_put32( mp, len + 1 );
+                    }
+                    mpack_put8( mp, as_bytes_get_type( bytes ) );
+            }
+            memcpy( mp->data + mp->len, as_bytes_get( bytes ), len );
+            mp->len += len;
+            return 0;
+        case AS_LIST:
+            return mpack_asarr( mp, (as_arraylist*)val );
+        case AS_MAP:
+            return mpack_asmap( mp, (as_hashmap*)val );
+    }
+    
+    // nil and unsupported data types
+    if( mpack_reserve( mp, 1 ) != 0 ){
+        return -1;
+    }
+    mpack_put8( mp, 0xc0 );
+    
+    return 0;
+}
+
+
+// encode bins of rec as a map; returns 0 or -1 on memory error
+int las_mpack_asrec( las_mpack_t *mp, const as_record *rec )
+{
+    as_record_iterator it;
+    as_bin *bin = NULL;
+    int rc = mpack_reserve( mp, 5 );
+    
+    if( rc == 0 )
+    {
+        size_t pos = mp->len;
+        
+        mp->len += 5;
+        rc = mpack_header( mp, pos, 5, LUA_TTABLE_HASH,
+                           as_record_numbins( (as_record*)rec ) );
+        as_record_iterator_init( &it, rec );
+        while( rc == 0 && as_record_iterator_has_next( &it ) )
+        {
+            bin = as_record_iterator_next( &it );
+            if( ( rc = mpack_str( mp, as_bin_get_name( bin ),
+                                  strlen( as_bin_get_name( bin ) ) ) ) == 0 ){
+                rc = mpack_asval( mp, (as_val*)as_bin_get_value( bin ) );
+            }
+        }
+        as_record_iterator_destroy( &it );
+    }
+    
+    return rc;
+}
+
+
+// MARK: decode msgpack to lua value
+#define mpack_has( p, end, n )  ((size_t)((end) - (p)) >= (size_t)(n))
+
+static inline uint16_t mpack_get16( const uint8_t *p )
+{
+    return (uint16_t)( p[0] << 8 | p[1] );
+}
+
+static inline uint32_t mpack_get32( const uint8_t *p )
+{
+    return (uint32_t)mpack_get16( p ) << 16 | mpack_get16( p + 2 );
+}
+
+static inline uint64_t mpack_get64( const uint8_t *p )
+{
+    return (uint64_t)mpack_get32( p ) << 32 | mpack_get32( p + 4 );
+}
+
+
+// returns 1 if value pushed, 0 if nil, LAS_MPACK_EXT if ext value skipped,
+// or -1 on malformed data
+static int unpack_val( lua_State *L, const uint8_t **p, const uint8_t *end );
+
+// ext value is the metadata that the server writes at the head of ordered
+// map and list. skip the header and payload of size len.
+static int unpack_ext( const uint8_t **p, const uint8_t *end, size_t len )
+{
+    // type byte and payload
+    if( !mpack_has( *p, end, len + 1 ) ){
+        return -1;
+    }
+    *p += len + 1;
+    
+    return LAS_MPACK_EXT;
+}
+
+// raw bytes are prefixed by the particle type
+static int unpack_raw( lua_State *L, const uint8_t **p, const uint8_t *end,
+                       size_t len )
+{
+    const uint8_t *raw = *p;
+    
+    if( !mpack_has( raw, end, len ) ){
+        return -1;
+    }
+    *p = raw + len;
+    
+    if( len ){
+        lua_pushlstring( L, (const char*)raw + 1, len - 1 );
+    }
+    else {
+        lua_pushliteral( L, "" );
+    }
+    
+    return 1;
+}
+
+
+static int unpack_arr( lua_State *L, const uint8_t **p, const uint8_t *end,
+                       uint32_t len )
+{
+    uint32_t idx = 1;
+    
+    // each element has 1 byte at least
+    if( !mpack_has( *p, end, len ) || !lua_checkstack( L, 2 ) ){
+        return -1;
+    }
+    
+    lua_createtable( L, len, 0 );
+    for(; len; len-- )
+    {
+        switch( unpack_val( L, p, end ) ){
+            case -1:
+                return -1;
+            // ext value is not an element
+            case LAS_MPACK_EXT:
+            break;
+            case 1:
+                lua_rawseti( L, -2, idx++ );
+            break;
+            // nil
+            default:
+                idx++;
+        }
+    }
+    
+    return 1;
+}
+
+
+// set len pairs into the table at the top of stack
+static int unpack_mapat( lua_State *L, const uint8_t **p, const uint8_t *end,
+                         uint32_t len )
+{
+    int rc = 0;
+    
+    // each pair has 2 bytes at least
+    if( !mpack_has( *p, end, (uint64_t)len * 2 ) || !lua_checkstack( L, 3 ) ){
+        return -1;
+    }
+    
+    for(; len; len-- )
+    {
+        if( ( rc = unpack_val( L, p, end ) ) == -1 ){
+            return -1;
+        }
+        // number of values pushed
+        rc = rc == 1;
+        switch( unpack_val( L, p, end ) ){
+            case -1:
+                return -1;
+            case 1:
+                if( rc ){
+                    lua_rawset( L, -3 );
+                }
+                // ignore nil or ext key
+                else {
+                    lua_pop( L, 1 );
+                }
+            break;
+            // ignore nil or ext value
+            default:
+                lua_pop( L, rc );
+        }
+    }
+    
+    return 1;
+}
+
+
+static int unpack_map( lua_State *L, const uint8_t **p, const uint8_t *end,
+                       uint32_t len )
+{
+    // each pair has 2 bytes at least
+    if( !mpack_has( *p, end, (uint64_t)len * 2 ) ){
+        return -1;
+    }
+    lua_createtable( L, 0, len );
+    
+    return unpack_mapat( L, p, end, len );
+}
+
+
+static int unpack_val( lua_State *L, const uint8_t **p, const uint8_t *end )
+{
+    const uint8_t *cur = *p;
+    uint8_t type = 0;
+    union {
+        uint32_t u32;
+        uint64_t u64;
+        float f;
+        double d;
+    } num;
+    
+    if( cur >= end ){
+        return -1;
+    }
+    
+    type = *cur++;
+    *p = cur;
+    // positive fixnum
+    if( type < 0x80 ){
+        lua_pushinteger( L, type );
+        return 1;
+    }
+    // fixmap
+    else if( type < 0x90 ){
+        return unpack_map( L, p, end, type & 0xf );
+    }
+    // fixarray
+    else if( type < 0xa0 ){
+        return unpack_arr( L, p, end, type & 0xf );
+    }
+    // fixraw
+    else if( type < 0xc0 ){
+        return unpack_raw( L, p, end, type & 0x1f );
+    }
+    // negative fixnum
+    else if( type >= 0xe0 ){
+        lua_pushinteger( L, (int8_t)type );
+        return 1;
+    }
+    
+    switch( type )
+    {
+        case 0xc0:
+            return 0;
+        case 0xc2:
+            lua_pushboolean( L, 0 );
+            return 1;
+        case 0xc3:
+            lua_pushboolean( L, 1 );
+            return 1;
+        
+        // bin 8 and str 8
+        case 0xc4:
+        case 0xd9:
+            if( !mpack_has( cur, end, 1 ) ){
+                return -1;
+            }
+            *p = cur + 1;
+            return unpack_raw( L, p, end, *cur );
+        // bin 16 and raw 16
+        case 0xc5:
+        case 0xda:
+            if( !mpack_has( cur, end, 2 ) ){
+                return -1;
+            }
+            *p = cur + 2;
+            return unpack_raw( L, p, end, mpack_get16( cur ) );
+        // bin 32 and raw 32
+        case 0xc6:
+        case 0xdb:
+            if( !mpack_has( cur, end, 4 ) ){
+                return -1;
+            }
+            *p = cur + 4;
+            return unpack_raw( L, p, end, mpack_get32( cur ) );
+        
+        // float and double
+        case 0xca:
+            if( !mpack_has( cur, end, 4 ) ){
+                return -1;
+            }
+            *p = cur + 4;
+            num.u32 = mpack_get32( cur );
+            lua_pushnumber( L, num.f );
+            return 1;
+        case 0xcb:
+            if( !mpack_has( cur, end, 8 ) ){
+                return -1;
+            }
+            *p = cur + 8;
+            num.u64 = mpack_get64( cur );
+            lua_pushnumber( L, num.d );
+            return 1;
+        
+        // unsigned integer
+        case 0xcc:
+        case 0xd0:
+            if( !mpack_has( cur, end, 1 ) ){
+                return -1;
+            }
+            *p = cur + 1;
+            if( type == 0xcc ){
+                lua_pushinteger( L, *cur );
+            }
+            else {
+                lua_pushinteger( L, (int8_t)*cur );
+            }
+            return 1;
+        case 0xcd:
+        case 0xd1:
+            if( !mpack_has( cur, end, 2 ) ){
+                return -1;
+            }
+            *p = cur + 2;
+            if( type == 0xcd ){
+                lua_pushinteger( L, mpack_get16( cur ) );
+            }
+            else {
+                lua_pushinteger( L, (int16_t)mpack_get16( cur ) );
+            }
+            return 1;
+        case 0xce:
+        case 0xd2:
+            if( !mpack_has( cur, end, 4 ) ){
+                return -1;
+            }
+            *p = cur + 4;
+            if( type == 0xce ){
+                lua_pushinteger( L, mpack_get32( cur ) );
+            }
+            else {
+                lua_pushinteger( L, (int32_t)mpack_get32( cur ) );
+            }
+            return 1;
+        case 0xcf:
+        case 0xd3:
+            if( !mpack_has( cur, end, 8 ) ){
+                return -1;
+            }
+            *p = cur + 8;
+            lua_pushinteger( L, (int64_t)mpack_get64( cur ) );
+            return 1;
+        
+        // array and map
+        case 0xdc:
+        case 0xde:
+            if( !mpack_has( cur, end, 2 ) ){
+                return -1;
+            }
+            *p = cur + 2;
+            if( type == 0xdc ){
+                return unpack_arr( L, p, end, mpack_get16( cur ) );
+            }
+            return unpack_map( L, p, end, mpack_get16( cur ) );
+        case 0xdd:
+        case 0xdf:
+            if( !mpack_has( cur, end, 4 ) ){
+                return -1;
+            }
+            *p = cur + 4;
+            if( type == 0xdd ){
+                return unpack_arr( L, p, end, mpack_get32( cur ) );
+            }
+            return unpack_map( L, p, end, mpack_get32( cur ) );
+        
+        // fixext 1, 2, 4, 8 and 16
+        case 0xd4:
+        case 0xd5:
+        case 0xd6:
+        case 0xd7:
+        case 0xd8:
+            return unpack_ext( p, end, (size_t)1 << ( type - 0xd4 ) );
+        // ext 8, 16 and 32
+        case 0xc7:
+            if( !mpack_has( cur, end, 1 ) ){
+                return -1;
+            }
+            *p = cur + 1;
+            return unpack_ext( p, end, *cur );
+        case 0xc8:
+            if( !mpack_has( cur, end, 2 ) ){
+                return -1;
+            }
+            *p = cur + 2;
+            return unpack_ext( p, end, mpack_get16( cur ) );
+        case 0xc9:
+            if( !mpack_has( cur, end, 4 ) ){
+                return -1;
+            }
+            *p = cur + 4;
+            return unpack_ext( p, end, mpack_get32( cur ) );
+    }
+    
+    // unsupported type
+    return -1;
+}
+
+
+// push the value of msgpack encoded map or list bin.
+// returns 1 if value pushed, 0 if nil, or -1 on malformed data.
+int las_mpack_raw2lua( lua_State *L, const uint8_t *data, size_t len )
+{
+    int top = lua_gettop( L );
+    const uint8_t *p = data;
+    
+    switch( unpack_val( L, &p, data + len ) ){
+        case 1:
+            return 1;
+        case -1:
+            lua_settop( L, top );
+            return -1;
+    }
+    
+    return 0;
+}
+
+
+// set pairs of msgpack encoded map into the table at the top of stack.
+// returns 0, or -1 on malformed data.
+int las_mpack_raw2tblat( lua_State *L, const uint8_t *data, size_t len )
+{
+    const uint8_t *p = data + 1;
+    const uint8_t *end = data + len;
+    
+    if( !len ){
+        return -1;
+    }
+    else if( ( *data & 0xf0 ) == 0x80 ){
+        return unpack_mapat( L, &p, end, *data & 0xf ) == -1 ? -1 : 0;
+    }
+    else if( *data == 0xde && mpack_has( p, end, 2 ) ){
+        p += 2;
+        return unpack_mapat( L, &p, end, mpack_get16( data + 1 ) ) == -1 ? -1 : 0;
+    }
+    else if( *data == 0xdf && mpack_has( p, end, 4 ) ){
+        p += 4;
+        return unpack_mapat( L, &p, end, mpack_get32( data + 1 ) ) == -1 ? -1 : 0;
+    }
+    
+    return -1;
+}
+
+
+// MARK: convert lua table to as_record
+// the table bins will be passed as msgpack encoded raw bytes.
+// rec must be initialized with the number of bins of lstate_tblnbins
+int las_mpack_tbl2asrec( lua_State *L, as_record *rec, las_mpack_t *mp )
+{
+    bool rv = true;
+    const char *name = NULL;
+    size_t len = 0;
+    uint16_t i = 0;
+    as_bin *bin = NULL;
+    
+    mp->len = 0;
+    // push space
+    lua_pushnil( L );
+    // key: -2, val: -1
+    while( rv && lua_next( L, -2 ) )
+    {
+        // check name length
+        if( !( name = LAS_CHK_BINNAME( L, -2 ) ) ){
+            lua_pushboolean( L, 0 );
+            lua_pushliteral( L, LAS_ERR_BIN_NAME );
+            return -1;
+        }
+        
+        switch( lua_type( L, -1 ) ){
+            case LUA_TNUMBER:
+                rv = as_record_set_int64( rec, name, lua_tointeger( L, -1 ) );
+            break;
+            case LUA_TBOOLEAN:
+                // drop bin if false
+                if( !lua_toboolean( L, -1 ) ){
+                    rv = as_record_set_nil( rec, name );
+                }
+            break;
+            case LUA_TSTRING:
+                rv = as_record_set_str( rec, name, lua_tostring( L, -1 ) );
+            break;
+            case LUA_TTABLE:
+                len = mp->len;
+                switch( mpack_tbl( L, mp ) ){
+                    case -1:
+                        return -1;
+                    case LUA_TTABLE_HASH:
+                        rv = as_record_set_raw_typep( rec, name, mp->data + len,
+                                                      mp->len - len,
+                                                      AS_BYTES_MAP, false );
+                    break;
+                    case LUA_TTABLE_LIST:
+                        rv = as_record_set_raw_typep( rec, name, mp->data + len,
+                                                      mp->len - len,
+                                                      AS_BYTES_LIST, false );
+                    break;
+                    // drop bin if empty
+                    default:
+                        mp->len = len;
+                        rv = as_record_set_nil( rec, name );
+                }
+            break;
+            
+            default:
+                lua_pushboolean( L, 0 );
+                lua_pushfstring( L, "%s = <%s> is unsupported data type",
+                                 name, lua_typename( L , lua_type( L, -2 ) ) );
+                return -1;
+        }
+        lua_pop( L, 1 );
+    }
+    
+    // push error
+    if( !rv ){
+        lua_pushboolean( L, 0 );
+        lua_pushstring( L, strerror( errno ) );
+        return -1;
+    }
+    
+    // buffer may be reallocated while encoding.
+    // encoded values are placed in order of bins.
+    for( len = 0; i < rec->bins.size; i++ )
+    {
+        bin = &rec->bins.entries[i];
+        if( as_val_type( (as_val*)bin->valuep ) == AS_BYTES &&
+            ( bin->valuep->bytes.type == AS_BYTES_MAP ||
+              bin->valuep->bytes.type == AS_BYTES_LIST ) ){
+            bin->valuep->bytes.value = mp->data + len;
+            len += bin->valuep->bytes.size;
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ *  Copyright 2014 Masatoshi Teruya. All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  las_mpack.h
+ *  lua-aerospike
+ *
+ *  Created by Masatoshi Teruya on 2014/09/12.
+ *
+ */
+
+#ifndef lua_aerospike_las_mpack_h
+#define lua_aerospike_las_mpack_h
+
+#include "las.h"
+
+// initial size of the msgpack buffer
+#define LAS_MPACK_BUFSIZE   4096
+
+// result of the decoder that skipped the ext value
+#define LAS_MPACK_EXT   2
+
+// reusable buffer for the msgpack encoded bin values
+typedef struct {
+    size_t len;
+    size_t size;
+    uint8_t *data;
+} las_mpack_t;
+
+
+#define las_mpack_init( mp ) do { \
+    (mp)->len = (mp)->size = 0; \
+    (mp)->data = NULL; \
+}while(0)
+
+#define las_mpack_dispose( mp ) do { \
+    if( (mp)->data ){ \
+        free( (mp)->data ); \
+        las_mpack_init( mp ); \
+    } \
+}while(0)
+
+
+// prototypes
+int las_mpack_tbl2asrec( lua_State *L, as_record *rec, las_mpack_t *mp );
+int las_mpack_raw2lua( lua_State *L, const uint8_t *data, size_t len );
+int las_mpack_raw2tblat( lua_State *L, const uint8_t *data, size_t len );
+int las_mpack_asrec( las_mpack_t *mp, const as_record *rec );
+
+
+#endif
@@ -28,6 +28,7 @@
  */
 
 #include "las_record.h"
+#include "las_key.h"
 
 
 static int verify( lua_State *L, int ttype, int vtype, int depth, void *udata )
@@ -91,10 +92,8 @@ static int newindex_lua( lua_State *L )
         case 2:
             if( strncmp( "pk", name, len ) == 0 )
             {
-                luaL_checktype( L, 3, LUA_TSTRING );
-                if( lrec->ref_key != LUA_NOREF ){
-                    lstate_unref( L, lrec->ref_key );
-                }
+                luaL_checkany( L, 3 );
+                lstate_unref( L, lrec->ref_key );
                 lrec->ref_key = lstate_ref( L, 3 );
             }
         break;
@@ -105,7 +104,7 @@ static int newindex_lua( lua_State *L )
                 if( ttl > UINT32_MAX ){
                     return luaL_error( L, LAS_ERR_TTL_RANGE );
                 }
-                lrec->ttl = (uint32_t)ttl;
+                lrec->rec.ttl = (uint32_t)ttl;
             }
         break;
         case 4:
@@ -113,6 +112,7 @@ static int newindex_lua( lua_State *L )
                 luaL_checktype( L, 3, LUA_TTABLE );
                 lstate_unref( L, lrec->ref_bins );
                 lrec->ref_bins = lstate_ref( L, 3 );
+                lrec->complete = 1;
             }
         break;
     }
@@ -121,6 +121,135 @@ static int newindex_lua( lua_State *L )
 }
 
 
+static void push_bins( lua_State *L, las_record_t *lrec )
+{
+    as_record_iterator it;
+    as_bin *bin = NULL;
+    
+    // convert all bins at once
+    if( lrec->ref_bins == LUA_NOREF )
+    {
+        if( lstate_asrec2tbl( L, &lrec->rec ) == -1 ){
+            luaL_error( L, LAS_ERR_BIN_DECODE );
+        }
+        lrec->ref_bins = lstate_ref( L, -1 );
+    }
+    else
+    {
+        lstate_pushref( L, lrec->ref_bins );
+        // convert the bins that are not cached yet
+        if( !lrec->complete )
+        {
+            as_record_iterator_init( &it, &lrec->rec );
+            while( as_record_iterator_has_next( &it ) )
+            {
+                bin = as_record_iterator_next( &it );
+                lua_pushstring( L, as_bin_get_name( bin ) );
+                lua_pushvalue( L, -1 );
+                lua_rawget( L, -3 );
+                if( !lua_isnil( L, -1 ) ){
+                    lua_pop( L, 2 );
+                    continue;
+                }
+                lua_pop( L, 1 );
+                switch( lstate_asval2lua( L, (as_val*)as_bin_get_value( bin ) ) ){
+                    case 1:
+                        lua_rawset( L, -3 );
+                    break;
+                    case 0:
+                        lua_pop( L, 1 );
+                    break;
+                    default:
+                        as_record_iterator_destroy( &it );
+                        luaL_error( L, LAS_ERR_BIN_DECODE );
+                }
+            }
+            as_record_iterator_destroy( &it );
+        }
+    }
+    
+    lrec->complete = 1;
+}
+
+
+// name: 2
+static int push_bin( lua_State *L, las_record_t *lrec, const char *name )
+{
+    as_bin_value *val = NULL;
+    
+    // read from the bins table
+    if( lrec->ref_bins != LUA_NOREF )
+    {
+        lstate_pushref( L, lrec->ref_bins );
+        lua_pushvalue( L, 2 );
+        lua_rawget( L, -2 );
+        if( lrec->complete || !lua_isnil( L, -1 ) ){
+            return 1;
+        }
+        lua_pop( L, 1 );
+    }
+    else {
+        lua_newtable( L );
+        lrec->ref_bins = lstate_ref( L, -1 );
+    }
+    
+    // convert a bin value and cache it into the bins table
+    if( ( val = as_record_get( &lrec->rec, name ) ) )
+    {
+        switch( lstate_asval2lua( L, (as_val*)val ) ){
+            case 1:
+                lua_pushvalue( L, 2 );
+                lua_pushvalue( L, -2 );
+                lua_rawset( L, -4 );
+                return 1;
+            case -1:
+                return luaL_error( L, LAS_ERR_BIN_DECODE );
+        }
+    }
+    
+    lua_pushnil( L );
+    
+    return 1;
+}
+
+
+// push the primary key value even if the key is an aerospike.key.
+// push nil if the record does not have a key.
+static void push_pk( lua_State *L, las_record_t *lrec )
+{
+    las_pk_t *pk = NULL;
+    
+    if( lrec->ref_key == LUA_NOREF )
+    {
+        if( lrec->rec.key.valuep || lrec->rec.key.digest.init ){
+            las_pk_push( L, &lrec->rec.key );
+        }
+        else {
+            lua_pushnil( L );
+        }
+    }
+    else
+    {
+        lstate_pushref( L, lrec->ref_key );
+        if( ( pk = lstate_toudata( L, -1, LAS_KEY_MT ) ) ){
+            lua_pop( L, 1 );
+            las_pk_push( L, &pk->key );
+        }
+    }
+}
+
+
+// name: 2
+// read the bin even if its name is same as the metadata field name
+static int bin_lua( lua_State *L )
+{
+    las_record_t *lrec = luaL_checkudata( L, 1, LAS_RECORD_MT );
+    const char *name = lstate_checkstring( L, 2 );
+    
+    return push_bin( L, lrec, name );
+}
+
+
 static int index_lua( lua_State *L )
 {
     las_record_t *lrec = luaL_checkudata( L, 1, LAS_RECORD_MT );
@@ -130,48 +259,55 @@ static int index_lua( lua_State *L )
     switch( len )
     {
         case 2:
-            if( strncmp( "pk", name, len ) == 0 )
-            {
-                if( lrec->ref_key == LUA_NOREF ){
-                    char pk[LAS_RECORD_PK_LEN] = {0};
-                    digest2hex( (uint8_t*)pk, lrec->pk, AS_DIGEST_VALUE_SIZE );
-                    lua_pushlstring( L, pk, LAS_RECORD_PK_LEN );
-                }
-                else {
-                    lstate_pushref( L, lrec->ref_key );
-                }
+            if( strncmp( "pk", name, len ) == 0 ){
+                push_pk( L, lrec );
                 return 1;
             }
         break;
         case 3:
-            if( strncmp( "ttl", name, len ) == 0 ){
-                lua_pushinteger( L, lrec->ttl );
+            if( strncmp( "bin", name, len ) == 0 ){
+                lua_pushcfunction( L, bin_lua );
+                return 1;
+            }
+            else if( strncmp( "ttl", name, len ) == 0 ){
+                lua_pushinteger( L, lrec->rec.ttl );
                 return 1;
             }
             else if( strncmp( "gen", name, len ) == 0 ){
-                lua_pushinteger( L, lrec->gen );
+                lua_pushinteger( L, lrec->rec.gen );
                 return 1;
             }
         break;
         case 4:
             if( strncmp( "bins", name, len ) == 0 ){
-                lstate_pushref( L, lrec->ref_bins );
+                push_bins( L, lrec );
                 return 1;
             }
         break;
         case 5:
-            if( strncmp( "nbins", name, len ) == 0 ){
-                lua_pushinteger( L, lrec->nbins );
+            if( strncmp( "nbins", name, len ) == 0 )
+            {
+                if( !lrec->complete ){
+                    lua_pushinteger( L, as_record_numbins( &lrec->rec ) );
+                }
+                else {
+                    size_t nbins = 0;
+                    
+                    lstate_pushref( L, lrec->ref_bins );
+                    lstate_tablelen( L, &nbins );
+                    lua_pop( L, 1 );
+                    lua_pushinteger( L, nbins );
+                }
                 return 1;
             }
             else if( strncmp( "valid", name, len ) == 0 ){
+                uint16_t nbins = 0;
                 int valid = 0;
                 
-                lrec->nbins = 0;
-                lstate_pushref( L, lrec->ref_bins );
+                push_bins( L, lrec );
                 // check bins table fields
                 lua_pushvalue( L, -1 );
-                valid = lstate_tblread( L, verify, &lrec->nbins );
+                valid = lstate_tblread( L, verify, &nbins );
                 lua_pop( L, 2 );
                 lua_pushboolean( L, valid == LSTATE_TBLREAD_DONE );
                 return 1;
@@ -179,8 +315,7 @@ static int index_lua( lua_State *L )
         break;
     }
     
-    lua_pushnil( L );
-    return 1;
+    return push_bin( L, lrec, name );
 }
 
 
@@ -196,31 +331,30 @@ static int gc_lua( lua_State *L )
     
     lstate_unref( L, lrec->ref_key );
     lstate_unref( L, lrec->ref_bins );
+    as_record_destroy( &lrec->rec );
 
     return 0;
 }
 
 
-int las_record_alloc_lua( lua_State *L, as_record *rec )
+/**
+ * push the record that bins will be read into lrec->rec.
+ * kidx is the stack index of pk, or 0 if it is read from the record key.
+ */
+las_record_t *las_record_alloc( lua_State *L, int kidx )
 {
     las_record_t *lrec = lua_newuserdata( L, sizeof( las_record_t ) );
     
     // allocate
     if( lrec ){
-        as_digest *digest = as_key_digest( &rec->key );
-        
+        as_record_init( &lrec->rec, 0 );
+        lrec->ref_key = kidx ? lstate_ref( L, kidx ) : LUA_NOREF;
+        lrec->ref_bins = LUA_NOREF;
+        lrec->complete = 0;
         lstate_setmetatable( L, LAS_RECORD_MT );
-        memcpy( lrec->pk, digest->value, AS_DIGEST_VALUE_SIZE );
-        lrec->ttl = rec->ttl;
-        lrec->gen = rec->gen;
-        lrec->nbins = lstate_asrec2tbl( L, rec );
-        lrec->ref_bins = lstate_ref( L, -1 );
-        lrec->ref_key = LUA_NOREF;
-        
-        return 0;
     }
     
-    return -1;
+    return lrec;
 }
 
 
@@ -246,13 +380,10 @@ static int alloc_lua( lua_State *L )
     }
     
     // allocate record
-    if( ( lrec = lua_newuserdata( L, sizeof( las_record_t ) ) ) ){
-        lstate_setmetatable( L, LAS_RECORD_MT );
-        lrec->ttl = (uint32_t)ttl;
-        lrec->gen = 0;
-        lrec->ref_key = lstate_ref( L, 1 );
+    if( ( lrec = las_record_alloc( L, 1 ) ) ){
+        lrec->rec.ttl = (uint32_t)ttl;
         lrec->ref_bins = lstate_ref( L, 2 );
-        lrec->nbins = 0;
+        lrec->complete = 1;
         return 1;
     }
     
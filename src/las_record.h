@@ -34,18 +34,21 @@
 
 #define LAS_RECORD_PK_LEN   (AS_DIGEST_VALUE_SIZE * 2)
 
+// bins of rec will be converted to lua value when it is indexed.
+// ref_bins is the bins table that caches the converted values, or assigned
+// by lua. complete is set if it holds all bins.
 typedef struct {
-    uint32_t ttl;
-    uint16_t gen;
-    uint16_t nbins;
-    uint8_t pk[LAS_RECORD_PK_LEN];
+    as_record rec;
     int ref_key;
     int ref_bins;
+    int complete;
 } las_record_t;
 
 
 // prototypes
 LUALIB_API int luaopen_aerospike_record( lua_State *L );
 
+las_record_t *las_record_alloc( lua_State *L, int kidx );
+
 
 #endif
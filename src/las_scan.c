@@ -0,0 +1,687 @@
+/*
+ *  Copyright 2014 Masatoshi Teruya. All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  las_scan.c
+ *  lua-aerospike
+ *
+ *  Created by Masatoshi Teruya on 2014/09/19.
+ *
+ */
+
+#include "las_scan.h"
+
+
+// MARK: scan queue
+int las_scanq_init( las_scanq_t *q, uint32_t size )
+{
+    if( !( q->recs = pnalloc( size, las_scanrec_t* ) ) ){
+        return -1;
+    }
+    pthread_mutex_init( &q->mutex, NULL );
+    pthread_cond_init( &q->readable, NULL );
+    pthread_cond_init( &q->writable, NULL );
+    q->size = size;
+    q->head = q->len = 0;
+    q->done = q->abort = 0;
+    q->rc = AEROSPIKE_OK;
+    as_error_init( &q->err );
+    
+    return 0;
+}
+
+
+// release the records that not consumed
+void las_scanq_dispose( las_scanq_t *q )
+{
+    for(; q->len; q->len-- ){
+        las_scanrec_free( q->recs[q->head] );
+        q->head = ( q->head + 1 ) % q->size;
+    }
+    pdealloc( q->recs );
+    pthread_cond_destroy( &q->writable );
+    pthread_cond_destroy( &q->readable );
+    pthread_mutex_destroy( &q->mutex );
+}
+
+
+// keep the first error of the scan unless the consumer has gone
+static void las_scanq_seterr( las_scanq_t *q, as_status rc, const char *msg )
+{
+    if( rc != AEROSPIKE_OK && q->rc == AEROSPIKE_OK && !q->abort ){
+        q->rc = rc;
+        as_error_update( &q->err, rc, "%s", msg );
+    }
+}
+
+
+// called by the client threads; the records are packed on the calling
+// thread and it waits while the queue is full.
+bool las_scanq_cb( const as_val *val, void *udata )
+{
+    las_scanq_t *q = (las_scanq_t*)udata;
+    as_record *rec = NULL;
+    las_scanrec_t *srec = NULL;
+    
+    // end of scan or not a record
+    if( !val || !( rec = as_record_fromval( val ) ) ){
+        return true;
+    }
+    else if( !( srec = pcalloc( 1, las_scanrec_t ) ) ||
+             las_mpack_asrec( &srec->mp, rec ) != 0 ){
+        las_scanrec_free( srec );
+        pthread_mutex_lock( &q->mutex );
+        las_scanq_seterr( q, AEROSPIKE_ERR_CLIENT, strerror( errno ) );
+        pthread_mutex_unlock( &q->mutex );
+        return false;
+    }
+    memcpy( srec->digest, as_key_digest( &rec->key )->value,
+            AS_DIGEST_VALUE_SIZE );
+    srec->ttl = rec->ttl;
+    srec->gen = rec->gen;
+    srec->nbins = as_record_numbins( rec );
+    
+    pthread_mutex_lock( &q->mutex );
+    while( q->len == q->size && !q->abort ){
+        pthread_cond_wait( &q->writable, &q->mutex );
+    }
+    // stop scan
+    if( q->abort ){
+        pthread_mutex_unlock( &q->mutex );
+        las_scanrec_free( srec );
+        return false;
+    }
+    q->recs[( q->head + q->len++ ) % q->size] = srec;
+    pthread_cond_signal( &q->readable );
+    pthread_mutex_unlock( &q->mutex );
+    
+    return true;
+}
+
+
+// returns NULL if the scan is finished
+las_scanrec_t *las_scanq_pop( las_scanq_t *q )
+{
+    las_scanrec_t *rec = NULL;
+    
+    return las_scanq_popn( q, &rec, 1 ) ? rec : NULL;
+}
+
+
+// take up to max records at once to reduce the lock contention with the
+// producers; returns 0 if the scan is finished
+uint32_t las_scanq_popn( las_scanq_t *q, las_scanrec_t **recs, uint32_t max )
+{
+    uint32_t n = 0;
+    
+    pthread_mutex_lock( &q->mutex );
+    while( !q->len && !q->done ){
+        pthread_cond_wait( &q->readable, &q->mutex );
+    }
+    for(; n < max && q->len; n++ ){
+        recs[n] = q->recs[q->head];
+        q->head = ( q->head + 1 ) % q->size;
+        q->len--;
+    }
+    // wake up all producers that waiting for the free slots
+    if( n ){
+        pthread_cond_broadcast( &q->writable );
+    }
+    pthread_mutex_unlock( &q->mutex );
+    
+    return n;
+}
+
+
+// the producers will stop the scan at the next record
+void las_scanq_abort( las_scanq_t *q )
+{
+    pthread_mutex_lock( &q->mutex );
+    q->abort = 1;
+    pthread_cond_broadcast( &q->writable );
+    pthread_mutex_unlock( &q->mutex );
+}
+
+
+static void las_scanq_close( las_scanq_t *q, as_status rc, as_error *err )
+{
+    pthread_mutex_lock( &q->mutex );
+    q->done = 1;
+    las_scanq_seterr( q, rc, err->message );
+    pthread_cond_broadcast( &q->readable );
+    pthread_mutex_unlock( &q->mutex );
+}
+
+
+// MARK: scanned record
+void las_scanrec_free( las_scanrec_t *rec )
+{
+    if( rec ){
+        las_mpack_dispose( &rec->mp );
+        pdealloc( rec );
+    }
+}
+
+
+// push the table of pk(hex string of digest), partition, ttl, gen and bins,
+// or returns -1 without pushing anything if the bins could not be decoded.
+int las_scanrec_push( lua_State *L, las_scanrec_t *rec )
+{
+    const int top = lua_gettop( L );
+    char id[AS_DIGEST_VALUE_SIZE * 2] = {0};
+    
+    digest2hex( (uint8_t*)id, rec->digest, AS_DIGEST_VALUE_SIZE );
+    lua_createtable( L, 0, 6 );
+    lstate_strn2tbl( L, "pk", id, AS_DIGEST_VALUE_SIZE * 2 );
+    lstate_num2tbl( L, "partition", las_partition_id( rec->digest ) );
+    lstate_num2tbl( L, "ttl", rec->ttl );
+    lstate_num2tbl( L, "gen", rec->gen );
+    if( rec->nbins ){
+        lua_pushliteral( L, "bins" );
+        lua_createtable( L, 0, rec->nbins );
+        if( las_mpack_raw2tblat( L, rec->mp.data, rec->mp.len ) != 0 ){
+            lua_settop( L, top );
+            return -1;
+        }
+        lua_rawset( L, -3 );
+    }
+    
+    return 0;
+}
+
+
+// MARK: scanner
+static void *scanner_run( void *arg )
+{
+    las_scanner_t *s = (las_scanner_t*)arg;
+    as_error err;
+    as_status rc;
+    
+    if( *s->node ){
+        rc = aerospike_scan_node( s->as, &err, s->policy, &s->scan, s->node,
+                                  las_scanq_cb, (void*)&s->q );
+    }
+    else {
+        rc = aerospike_scan_foreach( s->as, &err, s->policy, &s->scan,
+                                     las_scanq_cb, (void*)&s->q );
+    }
+    
+    las_scanq_close( &s->q, rc, &err );
+    
+    return NULL;
+}
+
+
+// run the scan on the new thread
+int las_scanner_start( las_scanner_t *s )
+{
+    int rc = pthread_create( &s->tid, NULL, scanner_run, (void*)s );
+    
+    if( rc != 0 ){
+        errno = rc;
+        return -1;
+    }
+    s->running = 1;
+    
+    return 0;
+}
+
+
+// scan will be released by the scanner even if failed.
+// scan all nodes if node is NULL
+int las_scanner_init( las_scanner_t *s, aerospike *as, as_policy_scan *policy,
+                      as_scan *scan, const char *node, uint32_t qsize )
+{
+    memcpy( &s->scan, scan, sizeof( as_scan ) );
+    s->as = as;
+    s->policy = policy;
+    *s->node = 0;
+    if( node ){
+        strncpy( s->node, node, AS_NODE_NAME_SIZE - 1 );
+        s->node[AS_NODE_NAME_SIZE - 1] = 0;
+    }
+    s->running = 0;
+    if( las_scanq_init( &s->q, qsize ) != 0 ){
+        as_scan_destroy( &s->scan );
+        return -1;
+    }
+    else if( las_scanner_start( s ) != 0 ){
+        las_scanq_dispose( &s->q );
+        as_scan_destroy( &s->scan );
+        return -1;
+    }
+    
+    return 0;
+}
+
+
+// stop the scan if it is not finished and wait for the thread
+void las_scanner_join( las_scanner_t *s )
+{
+    if( s->running ){
+        las_scanq_abort( &s->q );
+        pthread_join( s->tid, NULL );
+        s->running = 0;
+    }
+}
+
+
+void las_scanner_dispose( las_scanner_t *s )
+{
+    las_scanner_join( s );
+    las_scanq_dispose( &s->q );
+    as_scan_destroy( &s->scan );
+}
+
+
+// MARK: scan iterator
+// stop the scan and release the records that not consumed
+static void las_scaniter_release( las_scaniter_t *it )
+{
+    las_scanner_join( &it->s );
+    for(; it->cur < it->nrecs; it->cur++ ){
+        las_scanrec_free( it->recs[it->cur] );
+    }
+    it->cur = it->nrecs = 0;
+}
+
+
+// push the next record table, or returns 0 if the scan is finished.
+// the record is owned by the iterator until it has been pushed, so it will
+// be released by __gc even if a memory error is raised while pushing.
+// the scan will be stopped with the error if the record could not be decoded.
+int las_scaniter_pushnext( lua_State *L, las_scaniter_t *it )
+{
+    int rv = 0;
+    
+    if( it->cur == it->nrecs )
+    {
+        it->cur = it->nrecs = 0;
+        if( !it->s.running ||
+            !( it->nrecs = las_scanq_popn( &it->s.q, it->recs,
+                                           LAS_SCAN_NPOP ) ) ){
+            las_scanner_join( &it->s );
+            return 0;
+        }
+    }
+    
+    rv = las_scanrec_push( L, it->recs[it->cur] );
+    las_scanrec_free( it->recs[it->cur] );
+    it->cur++;
+    if( rv != 0 )
+    {
+        las_scaniter_release( it );
+        // scanner thread has gone; keep the first error of the scan
+        if( it->s.q.rc == AEROSPIKE_OK ){
+            it->s.q.rc = AEROSPIKE_ERR_CLIENT;
+            as_error_update( &it->s.q.err, AEROSPIKE_ERR_CLIENT, "%s",
+                             LAS_ERR_BIN_DECODE );
+        }
+        return 0;
+    }
+    
+    return 1;
+}
+
+
+// returns the next record, or nil(and error message) if the scan is
+// finished
+static int call_lua( lua_State *L )
+{
+    las_scaniter_t *it = luaL_checkudata( L, 1, LAS_SCANITER_MT );
+    
+    if( las_scaniter_pushnext( L, it ) ){
+        return 1;
+    }
+    
+    lua_pushnil( L );
+    if( it->s.q.rc != AEROSPIKE_OK ){
+        lua_pushstring( L, it->s.q.err.message );
+        return 2;
+    }
+    
+    return 1;
+}
+
+
+static int error_lua( lua_State *L )
+{
+    las_scaniter_t *it = luaL_checkudata( L, 1, LAS_SCANITER_MT );
+    
+    if( it->s.q.rc != AEROSPIKE_OK ){
+        lua_pushstring( L, it->s.q.err.message );
+    }
+    else {
+        lua_pushnil( L );
+    }
+    
+    return 1;
+}
+
+
+// stop the scan; buffered records will be discarded
+static int close_lua( lua_State *L )
+{
+    las_scaniter_t *it = luaL_checkudata( L, 1, LAS_SCANITER_MT );
+    
+    las_scaniter_release( it );
+    
+    return 0;
+}
+
+
+static int tostring_lua( lua_State *L )
+{
+    return TOSTRING_MT( L, LAS_SCANITER_MT );
+}
+
+
+static int gc_lua( lua_State *L )
+{
+    las_scaniter_t *it = (las_scaniter_t*)lua_touserdata( L, 1 );
+    
+    las_scaniter_release( it );
+    las_scanner_dispose( &it->s );
+    lstate_unref( L, it->ref_ctx );
+    
+    return 0;
+}
+
+
+// ctx: 1, scan will be released by the iterator even if failed.
+// push the iterator that the scanner thread is anchored in, or returns
+// NULL without pushing anything.
+// scan all nodes if node is NULL.
+las_scaniter_t *las_scaniter_alloc( lua_State *L, aerospike *as,
+                                    las_ctx_t *ctx, as_scan *scan,
+                                    const char *node, uint32_t qsize )
+{
+    las_scaniter_t *it = lua_newuserdata( L, sizeof( las_scaniter_t ) );
+    
+    if( !it ){
+        as_scan_destroy( scan );
+        return NULL;
+    }
+    else if( las_scanner_init( &it->s, as, &ctx->policies.scan, scan, node,
+                               qsize ) != 0 ){
+        lua_pop( L, 1 );
+        return NULL;
+    }
+    it->cur = it->nrecs = 0;
+    it->ref_ctx = lstate_ref( L, 1 );
+    lstate_setmetatable( L, LAS_SCANITER_MT );
+    
+    return it;
+}
+
+
+void las_scaniter_init( lua_State *L )
+{
+    struct luaL_Reg mmethod[] = {
+        { "__gc", gc_lua },
+        { "__tostring", tostring_lua },
+        { "__call", call_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg method[] = {
+        { "error", error_lua },
+        { "close", close_lua },
+        { NULL, NULL }
+    };
+    
+    lstate_definemt( L, LAS_SCANITER_MT, mmethod, method );
+}
+
+
+// MARK: background scan job
+typedef struct {
+    aerospike *as;
+    as_policy_info *policy;
+    uint64_t sid;
+    int ref_ctx;
+} las_scanjob_t;
+
+
+static as_status las_scanjob_info( las_scanjob_t *job, as_error *err,
+                                   as_scan_info *info )
+{
+    return aerospike_scan_info( job->as, err, job->policy, job->sid, info );
+}
+
+
+// returns { status = aerospike.SCAN_STATUS_*, progress = percent,
+//           records = number of scanned records }
+static int jobstatus_lua( lua_State *L )
+{
+    las_scanjob_t *job = luaL_checkudata( L, 1, LAS_SCANJOB_MT );
+    as_scan_info info;
+    as_error err;
+    
+    if( las_scanjob_info( job, &err, &info ) != AEROSPIKE_OK ){
+        lua_pushnil( L );
+        lua_pushstring( L, err.message );
+        return 2;
+    }
+    
+    lua_createtable( L, 0, 3 );
+    lstate_num2tbl( L, "status", info.status );
+    lstate_num2tbl( L, "progress", info.progress_pct );
+    lstate_num2tbl( L, "records", info.records_scanned );
+    
+    return 1;
+}
+
+
+static uint64_t las_scanjob_now( void )
+{
+    struct timeval tv;
+    
+    gettimeofday( &tv, NULL );
+    
+    return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000;
+}
+
+
+// timeout: 2 (msec; wait forever if nil)
+// returns true if the job completed, false if aborted, nil if timed out
+// or nil and error message.
+static int jobwait_lua( lua_State *L )
+{
+    las_scanjob_t *job = luaL_checkudata( L, 1, LAS_SCANJOB_MT );
+    uint64_t deadline = 0;
+    uint64_t now = 0;
+    uint64_t msec = LAS_SCANJOB_WAIT_MIN;
+    struct timespec ts;
+    as_scan_info info;
+    as_error err;
+    
+    // check timeout
+    if( !lua_isnoneornil( L, 2 ) )
+    {
+        lua_Integer timeout = lstate_checkinteger( L, 2 );
+        
+        if( timeout < 0 ){
+            return luaL_argerror( L, 2, LAS_ERR_SCANJOB_TIMEOUT );
+        }
+        deadline = las_scanjob_now() + (uint64_t)timeout;
+    }
+    
+    while( las_scanjob_info( job, &err, &info ) == AEROSPIKE_OK )
+    {
+        switch( info.status ){
+            // The scan is currently running.
+            case AS_SCAN_STATUS_INPROGRESS:
+            break;
+            
+            // The scan completed successfully.
+            case AS_SCAN_STATUS_COMPLETED:
+                lua_pushboolean( L, 1 );
+                return 1;
+            
+            // The scan was aborted. Due to failure or the user.
+            // AS_SCAN_STATUS_ABORTED
+            // The scan status is undefined.
+            // AS_SCAN_STATUS_UNDEF:
+            default:
+                lua_pushboolean( L, 0 );
+                return 1;
+        }
+        
+        // check timeout
+        if( deadline )
+        {
+            if( ( now = las_scanjob_now() ) >= deadline ){
+                lua_pushnil( L );
+                return 1;
+            }
+            else if( msec > deadline - now ){
+                msec = deadline - now;
+            }
+        }
+        
+        // wait with the exponential backoff
+        ts.tv_sec = (time_t)( msec / 1000 );
+        ts.tv_nsec = (long)( msec % 1000 ) * 1000000;
+        nanosleep( &ts, NULL );
+        if( ( msec <<= 1 ) > LAS_SCANJOB_WAIT_MAX ){
+            msec = LAS_SCANJOB_WAIT_MAX;
+        }
+    }
+    
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, err.message );
+    
+    return 2;
+}
+
+
+typedef struct {
+    int nok;
+} las_scanjob_abort_t;
+
+static bool scanjob_abort_cb( const as_error *err, const as_node *node,
+                              const char *req, char *res, void *udata )
+{
+    las_scanjob_abort_t *abt = (las_scanjob_abort_t*)udata;
+    
+    (void)node;
+    (void)req;
+    // response: <req>\t<result>\n
+    if( err->code == AEROSPIKE_OK && res && strstr( res, "\tOK" ) ){
+        abt->nok++;
+    }
+    
+    return true;
+}
+
+
+// returns true if the job aborted by any of nodes
+static int jobabort_lua( lua_State *L )
+{
+    las_scanjob_t *job = luaL_checkudata( L, 1, LAS_SCANJOB_MT );
+    char req[64];
+    las_scanjob_abort_t abt = {
+        .nok = 0
+    };
+    as_error err;
+    
+    snprintf( req, sizeof( req ), "scan-abort:id=%" PRIu64 "\n", job->sid );
+    if( aerospike_info_foreach( job->as, &err, job->policy, req,
+                                scanjob_abort_cb, (void*)&abt ) != AEROSPIKE_OK ){
+        lua_pushboolean( L, 0 );
+        lua_pushstring( L, err.message );
+        return 2;
+    }
+    lua_pushboolean( L, abt.nok > 0 );
+    
+    return 1;
+}
+
+
+// returns the scan id as a string since it may exceed the precision of
+// lua_Number
+static int jobid_lua( lua_State *L )
+{
+    las_scanjob_t *job = luaL_checkudata( L, 1, LAS_SCANJOB_MT );
+    char id[21] = {0};
+    
+    snprintf( id, sizeof( id ), "%" PRIu64, job->sid );
+    lua_pushstring( L, id );
+    
+    return 1;
+}
+
+
+static int jobtostring_lua( lua_State *L )
+{
+    return TOSTRING_MT( L, LAS_SCANJOB_MT );
+}
+
+
+static int jobgc_lua( lua_State *L )
+{
+    las_scanjob_t *job = (las_scanjob_t*)lua_touserdata( L, 1 );
+    
+    lstate_unref( L, job->ref_ctx );
+    
+    return 0;
+}
+
+
+// ctx: 1
+int las_scanjob_alloc( lua_State *L, aerospike *as, las_ctx_t *ctx,
+                       uint64_t sid )
+{
+    las_scanjob_t *job = lua_newuserdata( L, sizeof( las_scanjob_t ) );
+    
+    if( !job ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    job->as = as;
+    job->policy = &ctx->policies.info;
+    job->sid = sid;
+    job->ref_ctx = lstate_ref( L, 1 );
+    lstate_setmetatable( L, LAS_SCANJOB_MT );
+    
+    return 1;
+}
+
+
+void las_scanjob_init( lua_State *L )
+{
+    struct luaL_Reg mmethod[] = {
+        { "__gc", jobgc_lua },
+        { "__tostring", jobtostring_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg method[] = {
+        { "id", jobid_lua },
+        { "status", jobstatus_lua },
+        { "wait", jobwait_lua },
+        { "abort", jobabort_lua },
+        { NULL, NULL }
+    };
+    
+    lstate_definemt( L, LAS_SCANJOB_MT, mmethod, method );
+}
@@ -0,0 +1,132 @@
+/*
+ *  Copyright 2014 Masatoshi Teruya. All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  las_scan.h
+ *  lua-aerospike
+ *
+ *  Created by Masatoshi Teruya on 2014/09/19.
+ *
+ */
+
+#ifndef lua_aerospike_las_scan_h
+#define lua_aerospike_las_scan_h
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+#include "las.h"
+#include "las_ctx.h"
+#include "las_mpack.h"
+
+// default number of records that can be buffered by the scan queue
+#define LAS_SCAN_QSIZE  1024
+// max number of records that the consumer takes from the queue at once
+#define LAS_SCAN_NPOP   64
+
+// scanned record that packed by the client thread
+typedef struct {
+    as_digest_value digest;
+    uint32_t ttl;
+    uint16_t gen;
+    uint16_t nbins;
+    // encoded bins
+    las_mpack_t mp;
+} las_scanrec_t;
+
+// bounded queue between the client threads that deliver the scanned
+// records and the lua thread that consumes them.
+// it accepts the multiple producers since the client calls the callback
+// from the each node thread at once if the scan is concurrent.
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t readable;
+    pthread_cond_t writable;
+    las_scanrec_t **recs;
+    uint32_t size;
+    uint32_t head;
+    uint32_t len;
+    // scan is finished or the consumer has gone
+    int done;
+    int abort;
+    as_status rc;
+    as_error err;
+} las_scanq_t;
+
+// scan that runs on its own thread and delivers the records to the queue
+typedef struct {
+    aerospike *as;
+    as_policy_scan *policy;
+    as_scan scan;
+    las_scanq_t q;
+    // scan the specified node only if not empty
+    char node[AS_NODE_NAME_SIZE];
+    pthread_t tid;
+    int running;
+} las_scanner_t;
+
+// scanner anchored in the userdata; __gc stops the scan even if the lua
+// thread is unwound by an error while consuming the records.
+typedef struct {
+    las_scanner_t s;
+    // records taken from the queue but not pushed yet
+    las_scanrec_t *recs[LAS_SCAN_NPOP];
+    uint32_t nrecs;
+    uint32_t cur;
+    int ref_ctx;
+} las_scaniter_t;
+
+
+// backoff interval of waiting for the background scan job(msec)
+#define LAS_SCANJOB_WAIT_MIN    10
+#define LAS_SCANJOB_WAIT_MAX    1000
+
+
+// prototypes
+void las_scaniter_init( lua_State *L );
+void las_scanjob_init( lua_State *L );
+
+int las_scanq_init( las_scanq_t *q, uint32_t size );
+void las_scanq_dispose( las_scanq_t *q );
+bool las_scanq_cb( const as_val *val, void *udata );
+las_scanrec_t *las_scanq_pop( las_scanq_t *q );
+uint32_t las_scanq_popn( las_scanq_t *q, las_scanrec_t **recs, uint32_t max );
+void las_scanq_abort( las_scanq_t *q );
+
+int las_scanrec_push( lua_State *L, las_scanrec_t *rec );
+void las_scanrec_free( las_scanrec_t *rec );
+
+int las_scanner_init( las_scanner_t *s, aerospike *as, as_policy_scan *policy,
+                      as_scan *scan, const char *node, uint32_t qsize );
+int las_scanner_start( las_scanner_t *s );
+void las_scanner_join( las_scanner_t *s );
+void las_scanner_dispose( las_scanner_t *s );
+
+las_scaniter_t *las_scaniter_alloc( lua_State *L, aerospike *as,
+                                    las_ctx_t *ctx, as_scan *scan,
+                                    const char *node, uint32_t qsize );
+int las_scaniter_pushnext( lua_State *L, las_scaniter_t *it );
+int las_scanjob_alloc( lua_State *L, aerospike *as, las_ctx_t *ctx,
+                       uint64_t sid );
+
+
+#endif
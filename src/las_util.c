@@ -28,6 +28,7 @@
  */
 
 #include "las_util.h"
+#include "las_mpack.h"
 #include "bitvec.h"
 
 // MARK: table traverse
@@ -94,129 +95,282 @@ CHECK_REMAIN:
 
 
 // MARK: convert lua table to as_record
-static as_val *set_tbl2asmap( lua_State *L, const uint32_t len )
+// minimum capacity of the map, and number of the entries that can be
+// gathered on the C stack
+#define LSTATE_HASHMAP_CAPACITY 32
+
+// entry of the map that gathered while traversing the table
+typedef struct {
+    const char *name;
+    as_val *val;
+} lstate_mapent_t;
+
+
+// release the values and the entries that grown on the heap
+static void set_mapents_dispose( lstate_mapent_t *ents, uint32_t len,
+                                 lstate_mapent_t *stackents )
 {
-    as_map *map = (as_map*)as_hashmap_new( len );
+    uint32_t i = 0;
     
-    if( map )
-    {
-        as_val *val = NULL;
-        const char *name = NULL;
-        int rc = 0;
+    for(; i < len; i++ ){
+        as_val_destroy( ents[i].val );
+    }
+    if( ents != stackents ){
+        pdealloc( ents );
+    }
+}
+
+
+// convert the value at the top of stack, or returns NULL with the error
+// message if failed. returns &as_nil for the empty table.
+static as_val *set_val2asval( lua_State *L, const char *name )
+{
+    as_val *val = NULL;
+    
+    switch( lua_type( L, -1 ) ){
+        case LUA_TSTRING:
+            val = (as_val*)as_string_new_strdup( lua_tostring( L, -1 ) );
+        break;
+        case LUA_TNUMBER:
+            val = (as_val*)as_integer_new( lua_tointeger( L, -1 ) );
+        break;
+        case LUA_TBOOLEAN:
+            val = (as_val*)as_integer_new( lua_toboolean( L, -1 ) );
+        break;
+        case LUA_TTABLE:
+            return lstate_tbl2asval( L );
         
-        // push space
-        lua_pushnil( L );
-        // key: -2, val: -1
-        while( rc == 0 && lua_next( L, -2 ) )
+        // unsupported data type
+        default:
+            lua_pushboolean( L, 0 );
+            lua_pushfstring( L, "unsupported data type %s at field %s",
+                             lua_typename( L, lua_type( L, -1 ) ), name );
+            return NULL;
+    }
+    
+    if( !val ){
+        lua_pushboolean( L, 0 );
+        lua_pushstring( L, strerror( errno ) );
+    }
+    
+    return val;
+}
+
+
+// the entries are gathered in one traversal, and the map is sized by the
+// number of them. names refer to the keys of the table at the top of stack.
+static as_val *set_tbl2asmap( lua_State *L )
+{
+    lstate_mapent_t stackents[LSTATE_HASHMAP_CAPACITY];
+    lstate_mapent_t *ents = stackents;
+    lstate_mapent_t *tmp = NULL;
+    uint32_t cap = LSTATE_HASHMAP_CAPACITY;
+    uint32_t len = 0;
+    uint32_t i = 0;
+    as_map *map = NULL;
+    as_val *val = NULL;
+    const char *name = NULL;
+    
+    // push space
+    lua_pushnil( L );
+    // key: -2, val: -1
+    while( lua_next( L, -2 ) )
+    {
+        // table that includes both of array and hash
+        if( lua_type( L, -2 ) != LUA_TSTRING ){
+            set_mapents_dispose( ents, len, stackents );
+            lua_pushboolean( L, 0 );
+            lua_pushliteral( L, LAS_ERR_TABLE_MIXED );
+            return NULL;
+        }
+        name = lua_tostring( L, -2 );
+        if( !( val = set_val2asval( L, name ) ) ){
+            set_mapents_dispose( ents, len, stackents );
+            return NULL;
+        }
+        lua_pop( L, 1 );
+        // empty table
+        if( (uintptr_t)val == (uintptr_t)&as_nil ){
+            continue;
+        }
+        // grow the entries
+        else if( len == cap )
         {
-            name = lua_tostring( L, -2 );
-            switch( lua_type( L, -1 ) ){
-                case LUA_TSTRING:
-                    rc = as_stringmap_set_str( map, name, lua_tostring( L, -1 ) );
-                break;
-                case LUA_TNUMBER:
-                    rc = as_stringmap_set_int64( map, name, lua_tointeger( L, -1 ) );
-                break;
-                case LUA_TBOOLEAN:
-                    rc = as_stringmap_set_int64( map, name, lua_toboolean( L, -1 ) );
-                break;
-                case LUA_TTABLE:
-                    if( !( val = lstate_tbl2asval( L ) ) ){
-                        as_map_destroy( map );
-                        return NULL;
-                    }
-                    else if( (uintptr_t)val != (uintptr_t)&as_nil ){
-                        rc = as_stringmap_set( map, name, val );
-                    }
-                break;
-                
-                // unsupported data type
-                default:
-                    as_map_destroy( map );
-                    lua_pushboolean( L, 0 );
-                    lua_pushfstring( L, "unsupported data type %s at field %s",
-                                     lua_typename( L, lua_type( L, -2 ) ), name );
-                    return NULL;
+            if( ents == stackents ){
+                if( ( tmp = pnalloc( cap * 2, lstate_mapent_t ) ) ){
+                    memcpy( tmp, stackents, sizeof( lstate_mapent_t ) * len );
+                }
             }
-            lua_pop( L, 1 );
+            else {
+                tmp = prealloc( cap * 2, lstate_mapent_t, ents );
+            }
+            if( !tmp ){
+                as_val_destroy( val );
+                set_mapents_dispose( ents, len, stackents );
+                lua_pushboolean( L, 0 );
+                lua_pushstring( L, strerror( errno ) );
+                return NULL;
+            }
+            ents = tmp;
+            cap *= 2;
         }
-        
-        // FIXME: cannot find error code descriptions.
-        // check error code
-        if( rc != 0 ){
+        ents[len].name = name;
+        ents[len].val = val;
+        len++;
+    }
+    
+    if( !( map = (as_map*)as_hashmap_new( len > LSTATE_HASHMAP_CAPACITY ?
+                                          len : LSTATE_HASHMAP_CAPACITY ) ) ){
+        set_mapents_dispose( ents, len, stackents );
+        lua_pushboolean( L, 0 );
+        lua_pushstring( L, strerror( errno ) );
+        return NULL;
+    }
+    // FIXME: cannot find error code descriptions.
+    // the map owns the values that have been set
+    for(; i < len; i++ )
+    {
+        if( as_stringmap_set( map, ents[i].name, ents[i].val ) != 0 ){
             as_map_destroy( map );
+            // release the values that not owned by the map
+            memmove( ents, ents + i, sizeof( lstate_mapent_t ) * ( len - i ) );
+            set_mapents_dispose( ents, len - i, stackents );
             lua_pushboolean( L, 0 );
             lua_pushstring( L, strerror( errno ) );
             return NULL;
         }
     }
+    if( ents != stackents ){
+        pdealloc( ents );
+    }
     
     return (as_val*)map;
 }
 
 
+// set the value at the top of stack into the list at idx.
+// returns AS_ARRAYLIST_OK, error code of as_arraylist, or -1 if the error
+// message has been pushed.
+static int set_ival2asarr( lua_State *L, as_arraylist *list, uint32_t idx )
+{
+    as_val *val = NULL;
+    
+    switch( lua_type( L, -1 ) ){
+        case LUA_TSTRING:
+            return as_arraylist_set_str( list, idx, lua_tostring( L, -1 ) );
+        case LUA_TNUMBER:
+            return as_arraylist_set_int64( list, idx, lua_tointeger( L, -1 ) );
+        case LUA_TBOOLEAN:
+            return as_arraylist_set_int64( list, idx, lua_toboolean( L, -1 ) );
+        case LUA_TTABLE:
+            if( !( val = lstate_tbl2asval( L ) ) ){
+                return -1;
+            }
+            else if( (uintptr_t)val != (uintptr_t)&as_nil ){
+                return as_arraylist_set( list, idx, val );
+            }
+            return AS_ARRAYLIST_OK;
+    }
+    
+    // unsupported data type
+    lua_pushboolean( L, 0 );
+    lua_pushfstring( L, "unsupported data type %s at index %u",
+                     lua_typename( L, lua_type( L, -2 ) ), idx );
+    return -1;
+}
+
+
+// release the list and push the error of rc that returned by
+// set_ival2asarr
+static as_val *set_asarr_error( lua_State *L, as_arraylist *list, int rc )
+{
+    as_arraylist_destroy( list );
+    switch( rc ){
+        case AS_ARRAYLIST_ERR_ALLOC:
+            lua_pushboolean( L, 0 );
+            lua_pushstring( L, strerror( errno ) );
+        break;
+        // does not reach here
+        case AS_ARRAYLIST_ERR_MAX:
+            lua_pushboolean( L, 0 );
+            lua_pushfstring( L, "%d", AS_ARRAYLIST_ERR_MAX );
+        break;
+    }
+    
+    return NULL;
+}
+
+
+// convert the sequence that lua_next does not traverse in order of keys.
+// keys are checked by lstate_seqlen and the items are read by lua_rawgeti.
+static as_val *set_seq2asarr( lua_State *L )
+{
+    size_t len = lstate_seqlen( L );
+    as_arraylist *list = NULL;
+    uint32_t idx = 0;
+    int rc = AS_ARRAYLIST_OK;
+    
+    if( !len ){
+        lua_pushboolean( L, 0 );
+        if( lstate_tablelen( L, &len ) == LUA_TTABLE_LIST ){
+            lua_pushliteral( L, LAS_ERR_TABLE_SPARSE );
+        }
+        else {
+            lua_pushliteral( L, LAS_ERR_TABLE_MIXED );
+        }
+        return NULL;
+    }
+    else if( ( list = as_arraylist_new( (uint32_t)len, 0 ) ) )
+    {
+        for(; idx < len; idx++ )
+        {
+            lua_rawgeti( L, -1, (int)idx + 1 );
+            if( ( rc = set_ival2asarr( L, list, idx ) ) != AS_ARRAYLIST_OK ){
+                return set_asarr_error( L, list, rc );
+            }
+            lua_pop( L, 1 );
+        }
+    }
+    
+    return (as_val*)list;
+}
+
+
+// items are set as they are traversed while the keys are 1, 2, 3...,
+// it falls back to set_seq2asarr if a key is out of order.
+// len: lua_objlen of the table
 static as_val *set_tbl2asarr( lua_State *L, const uint32_t len )
 {
     as_arraylist *list = as_arraylist_new( len, 0 );
     
     if( list )
     {
-        as_val *val = NULL;
         uint32_t idx = 0;
         int rc = AS_ARRAYLIST_OK;
         
         // push space
         lua_pushnil( L );
         // key: -2, val: -1
-        while( rc == AS_ARRAYLIST_OK && lua_next( L, -2 ) )
+        while( lua_next( L, -2 ) )
         {
-            switch( lua_type( L, -1 ) ){
-                case LUA_TSTRING:
-                    rc = as_arraylist_set_str( list, idx, lua_tostring( L, -1 ) );
-                break;
-                case LUA_TNUMBER:
-                    rc = as_arraylist_set_int64( list, idx, lua_tointeger( L, -1 ) );
-                break;
-                case LUA_TBOOLEAN:
-                    rc = as_arraylist_set_int64( list, idx, lua_toboolean( L, -1 ) );
-                break;
-                case LUA_TTABLE:
-                    if( !( val = lstate_tbl2asval( L ) ) ){
-                        as_arraylist_destroy( list );
-                        return NULL;
-                    }
-                    else if( (uintptr_t)val != (uintptr_t)&as_nil ){
-                        rc = as_arraylist_set( list, idx, val );
-                    }
-                break;
-                
-                // unsupported data type
-                default:
-                    as_arraylist_destroy( list );
-                    lua_pushboolean( L, 0 );
-                    lua_pushfstring( L, "unsupported data type %s at index %u",
-                                     lua_typename( L, lua_type( L, -2 ) ), idx );
-                    return NULL;
-            }
-            lua_pop( L, 1 );
-            idx++;
-        }
-        
-        // check error code
-        switch( rc ){
-            case AS_ARRAYLIST_ERR_ALLOC:
+            // table that includes both of array and hash
+            if( lua_type( L, -2 ) != LUA_TNUMBER ){
                 as_arraylist_destroy( list );
                 lua_pushboolean( L, 0 );
-                lua_pushstring( L, strerror( errno ) );
+                lua_pushliteral( L, LAS_ERR_TABLE_MIXED );
                 return NULL;
-            break;
-            // does not reach here
-            case AS_ARRAYLIST_ERR_MAX:
+            }
+            // key is out of order
+            else if( lua_tonumber( L, -2 ) != (lua_Number)idx + 1 ){
                 as_arraylist_destroy( list );
-                lua_pushboolean( L, 0 );
-                lua_pushfstring( L, "%d", AS_ARRAYLIST_ERR_MAX );
-                return NULL;
-            break;
+                lua_pop( L, 2 );
+                return set_seq2asarr( L );
+            }
+            else if( ( rc = set_ival2asarr( L, list, idx ) ) != AS_ARRAYLIST_OK ){
+                return set_asarr_error( L, list, rc );
+            }
+            lua_pop( L, 1 );
+            idx++;
         }
     }
     
@@ -224,119 +378,58 @@ static as_val *set_tbl2asarr( lua_State *L, const uint32_t len )
 }
 
 
+// table is classified by the first key and converted in one traversal.
 as_val *lstate_tbl2asval( lua_State *L )
 {
-    size_t len = 0;
-    int type = lstate_tablelen( L, &len );
+    int type = LUA_TNIL;
+    
+    // type of the first key
+    lua_pushnil( L );
+    if( lua_next( L, -2 ) ){
+        type = lua_type( L, -2 );
+        lua_pop( L, 2 );
+    }
     
     switch( type ){
-        case LUA_TTABLE_HASH:
-            return set_tbl2asmap( L, (uint32_t)len );
-        break;
-        case LUA_TTABLE_LIST:
-            return set_tbl2asarr( L, (uint32_t)len );
-        break;
-        case LUA_TTABLE_EMPTY:
+        case LUA_TSTRING:
+            return set_tbl2asmap( L );
+        case LUA_TNUMBER:
+            return set_tbl2asarr( L, (uint32_t)lua_objlen( L, -1 ) );
+        case LUA_TNIL:
             return (as_val*)&as_nil;
-
+        
         default:
             lua_pushboolean( L, 0 );
-            lua_pushliteral( L, "should not be included both of array and hash" );
+            lua_pushliteral( L, LAS_ERR_TABLE_MIXED );
             return NULL;
     }
 }
 
 
 // 1 = las_ctx_t, 2 = key string, 3 = record table, 4 = ttl
-as_record *lstate_tbl2asrec( lua_State *L )
+int lstate_tblnbins( lua_State *L, uint16_t *nbins )
 {
-    bool rv = true;
     size_t len = 0;
-    as_bin_value *bin = NULL;
-    const char *name = NULL;
-    as_record *rec = NULL;
     
     // check table
     if( lstate_tablelen( L, &len ) != LUA_TTABLE_HASH ){
         lua_pushboolean( L, 0 );
         lua_pushliteral( L, "record must be hash table" );
-        return NULL;
+        return -1;
     }
     // number of bin limit exceeded
     else if( len >= UINT16_MAX ){
         lua_pushboolean( L, 0 );
         lua_pushliteral( L, LAS_ERR_BIN_LIMIT );
-        return NULL;
-    }
-    // allocate record
-    else if( !( rec = as_record_new( (uint16_t)len ) ) ){
-        lua_pushboolean( L, 0 );
-        lua_pushstring( L, strerror( errno ) );
-        return NULL;
+        return -1;
     }
     
-    // push space
-    lua_pushnil( L );
-    // key: -2, val: -1
-    while( rv && lua_next( L, -2 ) )
-    {
-        // check name length
-        if( !( name = LAS_CHK_BINNAME( L, -2 ) ) ){
-            lua_pushboolean( L, 0 );
-            lua_pushliteral( L, LAS_ERR_BIN_NAME );
-            as_record_destroy( rec );
-            return NULL;
-        }
-        
-        switch( lua_type( L, -1 ) ){
-            case LUA_TNUMBER:
-                rv = as_record_set_int64( rec, name, lua_tointeger( L, -1 ) );
-            break;
-            case LUA_TBOOLEAN:
-                // drop bin if false
-                if( !lua_toboolean( L, -1 ) ){
-                    rv = as_record_set_nil( rec, name );
-                }
-            break;
-            case LUA_TSTRING:
-                rv = as_record_set_str( rec, name, lua_tostring( L, -1 ) );
-            break;
-            case LUA_TTABLE:
-                if( !( bin = (as_bin_value*)lstate_tbl2asval( L ) ) ){
-                    as_record_destroy( rec );
-                    return NULL;
-                }
-                else if( (uintptr_t)bin != (uintptr_t)&as_nil ){
-                    rv = as_record_set( rec, name, bin );
-                }
-                else {
-                    rv = as_record_set_nil( rec, name );
-                }
-            break;
-            
-            default:
-                lua_pushboolean( L, 0 );
-                lua_pushfstring( L, "%s = <%s> is unsupported data type",
-                                 name, lua_typename( L , lua_type( L, -2 ) ) );
-                as_record_destroy( rec );
-                return NULL;
-        }
-        lua_pop( L, 1 );
-    }
+    *nbins = (uint16_t)len;
     
-    // push error
-    if( !rv ){
-        lua_pushboolean( L, 0 );
-        lua_pushstring( L, strerror( errno ) );
-        as_record_destroy( rec );
-        return NULL;
-    }
-
-    return rec;
+    return 0;
 }
 
 
-
 // MARK: convert lua table to as_query
 static int set_tbl2asqry_orderby( lua_State *L, as_query *qry )
 {
@@ -561,40 +654,48 @@ as_query *lstate_tbl2asqry( lua_State *L, const char *ns, const char *set )
 
 
 // MARK: convert record to lua table
-static void set_kval2lua( lua_State *L, const char *name, as_val *val );
-static void set_ival2lua( lua_State *L, int idx, as_val *val );
+static int set_kval2lua( lua_State *L, const char *name, as_val *val );
+static int set_ival2lua( lua_State *L, int idx, as_val *val );
 
-static void set_asmap2tbl( lua_State *L, as_hashmap *map )
+static int set_asmap2tbl( lua_State *L, as_hashmap *map )
 {
     as_pair *val = NULL;
     as_hashmap_iterator it;
+    int rc = 0;
     
     lua_createtable( L, 0, as_hashmap_size( map ) );
     as_hashmap_iterator_init( &it, map );
-    while( as_hashmap_iterator_has_next( &it ) ){
+    while( rc == 0 && as_hashmap_iterator_has_next( &it ) ){
         val = (as_pair*)as_hashmap_iterator_next( &it );
-        set_kval2lua( L, as_string_get( (const as_string*)as_pair_1( val ) ),
-                      as_pair_2( val ) );
+        rc = set_kval2lua( L, as_string_get( (const as_string*)as_pair_1( val ) ),
+                           as_pair_2( val ) );
     }
     as_hashmap_iterator_destroy( &it );
+    
+    return rc;
 }
 
-static void set_asarr2tbl( lua_State *L, as_arraylist *arr )
+static int set_asarr2tbl( lua_State *L, as_arraylist *arr )
 {
     as_val *val = NULL;
     as_arraylist_iterator it;
     int i = 1;
+    int rc = 0;
     
     lua_createtable( L, as_arraylist_size( arr ), 0 );
     as_arraylist_iterator_init( &it, arr );
-    while( as_arraylist_iterator_has_next( &it ) ){
+    while( rc == 0 && as_arraylist_iterator_has_next( &it ) ){
         val = (as_val*)as_arraylist_iterator_next( &it );
-        set_ival2lua( L, i++, val );
+        rc = set_ival2lua( L, i++, val );
     }
     as_arraylist_iterator_destroy( &it );
+    
+    return rc;
 }
 
 
+// returns 1 if value pushed, 0 if nil or unsupported data type, or -1 if
+// the map or list bin could not be decoded.
 int lstate_asval2lua( lua_State *L, as_val *val )
 {
     switch( as_val_type( val ) ){
@@ -608,18 +709,31 @@ int lstate_asval2lua( lua_State *L, as_val *val )
             lua_pushstring( L, as_string_get( (as_string*)val ) );
         break;
         case AS_BYTES:
-            lua_pushlstring( L, (char*)as_bytes_get( (as_bytes*)val ),
-                             as_bytes_size( (as_bytes*)val ) );
+            switch( as_bytes_get_type( (as_bytes*)val ) ){
+                // map and list that not deserialized by the client
+                case AS_BYTES_MAP:
+                case AS_BYTES_LIST:
+                    return las_mpack_raw2lua( L, as_bytes_get( (as_bytes*)val ),
+                                              as_bytes_size( (as_bytes*)val ) );
+                default:
+                    lua_pushlstring( L, (char*)as_bytes_get( (as_bytes*)val ),
+                                     as_bytes_size( (as_bytes*)val ) );
+            }
         break;
         case AS_LIST:
-            set_asarr2tbl( L, (as_arraylist*)val );
+            if( set_asarr2tbl( L, (as_arraylist*)val ) != 0 ){
+                lua_pop( L, 1 );
+                return -1;
+            }
         break;
         case AS_MAP:
-            set_asmap2tbl( L, (as_hashmap*)val );
+            if( set_asmap2tbl( L, (as_hashmap*)val ) != 0 ){
+                lua_pop( L, 1 );
+                return -1;
+            }
         break;
         case AS_REC:
-            lstate_asrec2tbl( L, (as_record*)val );
-        break;
+            return lstate_asrec2tbl( L, (as_record*)val ) == -1 ? -1 : 1;
         
         // other: unsupported data types
         // ignore nil value
@@ -630,49 +744,96 @@ int lstate_asval2lua( lua_State *L, as_val *val )
     return 1;
 }
 
-static void set_kval2lua( lua_State *L, const char *name, as_val *val )
+static int set_kval2lua( lua_State *L, const char *name, as_val *val )
 {
     lua_pushstring( L, name );
-    if( lstate_asval2lua( L, val ) ){
-        lua_rawset( L, -3 );
-    }
-    else {
-        lua_pop( L, 1 );
+    switch( lstate_asval2lua( L, val ) ){
+        case 1:
+            lua_rawset( L, -3 );
+            return 0;
+        case 0:
+            lua_pop( L, 1 );
+            return 0;
     }
+    
+    lua_pop( L, 1 );
+    return -1;
 }
 
 
-static void set_ival2lua( lua_State *L, int idx, as_val *val )
+static int set_ival2lua( lua_State *L, int idx, as_val *val )
 {
     lua_pushnumber( L, idx );
-    if( lstate_asval2lua( L, val ) ){
-        lua_rawset( L, -3 );
-    }
-    else {
-        lua_pop( L, 1 );
+    switch( lstate_asval2lua( L, val ) ){
+        case 1:
+            lua_rawset( L, -3 );
+            return 0;
+        case 0:
+            lua_pop( L, 1 );
+            return 0;
     }
+    
+    lua_pop( L, 1 );
+    return -1;
 }
 
 
-uint16_t lstate_asrec2tbl( lua_State *L, as_record *rec )
+// set bins into the table at the top of stack.
+// returns number of bins, or -1 if a bin could not be decoded.
+int lstate_asrec2tblat( lua_State *L, as_record *rec )
 {
     as_record_iterator it;
     as_bin *bin = NULL;
-    uint16_t nbin = as_record_numbins( rec );
+    int rc = 0;
     
-    lua_createtable( L, 0, nbin );
-    if( nbin )
-    {
-        as_record_iterator_init( &it, rec );
-        while( as_record_iterator_has_next( &it ) ){
-            bin = as_record_iterator_next( &it );
-            set_kval2lua( L, as_bin_get_name( bin ), (as_val*)as_bin_get_value( bin ) );
-        }
-        as_record_iterator_destroy( &it );
+    as_record_iterator_init( &it, rec );
+    while( rc == 0 && as_record_iterator_has_next( &it ) ){
+        bin = as_record_iterator_next( &it );
+        rc = set_kval2lua( L, as_bin_get_name( bin ),
+                           (as_val*)as_bin_get_value( bin ) );
     }
+    as_record_iterator_destroy( &it );
     
-    return nbin;
+    return rc == 0 ? as_record_numbins( rec ) : -1;
 }
 
 
+// push the table of bins; nothing is pushed if returns -1.
+int lstate_asrec2tbl( lua_State *L, as_record *rec )
+{
+    lua_createtable( L, 0, as_record_numbins( rec ) );
+    if( lstate_asrec2tblat( L, rec ) == -1 ){
+        lua_pop( L, 1 );
+        return -1;
+    }
+    
+    return as_record_numbins( rec );
+}
+
 
+// set ttl, gen and bins of rec into the table at the top of stack.
+// the bins table will be cleared and reused if exists.
+// returns 0, or -1 if a bin could not be decoded.
+int lstate_asrec2result( lua_State *L, as_record *rec )
+{
+    lstate_num2tbl( L, "ttl", rec->ttl );
+    lstate_num2tbl( L, "gen", rec->gen );
+    lua_pushliteral( L, "bins" );
+    lua_pushvalue( L, -1 );
+    lua_rawget( L, -3 );
+    if( !lua_istable( L, -1 ) ){
+        lua_pop( L, 1 );
+        lua_createtable( L, 0, as_record_numbins( rec ) );
+    }
+    else {
+        lstate_tblclear( L, -1 );
+    }
+    
+    if( lstate_asrec2tblat( L, rec ) == -1 ){
+        lua_pop( L, 2 );
+        return -1;
+    }
+    lua_rawset( L, -3 );
+    
+    return 0;
+}
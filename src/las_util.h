@@ -40,6 +40,14 @@
 #define pdealloc(p)     free((void*)p)
 
 
+// number of partitions of namespace
+#define LAS_NPARTITION  4096
+
+// partition id that the digest belongs to
+#define las_partition_id( digest ) \
+    ((uint32_t)( (digest)[0] | ( (digest)[1] << 8 ) ) & ( LAS_NPARTITION - 1 ))
+
+
 // buf size must be larger than len*2
 static inline void digest2hex( uint8_t *buf, uint8_t digest[], size_t len )
 {
@@ -54,6 +62,40 @@ static inline void digest2hex( uint8_t *buf, uint8_t digest[], size_t len )
 }
 
 
+// returns -1 if hex is not a hex string of len*2 characters
+static inline int hex2digest( uint8_t digest[], const uint8_t *hex, size_t len )
+{
+    size_t i = 0;
+    uint8_t c, v;
+    
+    for(; i < len * 2; i++ )
+    {
+        c = hex[i];
+        if( c >= '0' && c <= '9' ){
+            v = c - '0';
+        }
+        else if( c >= 'a' && c <= 'f' ){
+            v = c - 'a' + 10;
+        }
+        else if( c >= 'A' && c <= 'F' ){
+            v = c - 'A' + 10;
+        }
+        else {
+            return -1;
+        }
+        
+        if( i & 1 ){
+            digest[i/2] |= v;
+        }
+        else {
+            digest[i/2] = v << 4;
+        }
+    }
+    
+    return 0;
+}
+
+
 // helper macros
 #define lstate_setmetatable(L,tname) do { \
     luaL_getmetatable( L, tname ); \
@@ -164,6 +206,44 @@ static inline void digest2hex( uint8_t *buf, uint8_t digest[], size_t len )
 #define lstate_isref(ref)   ((ref) > 0)
 
 
+// returns userdata if the value at idx has a metatable of tname
+static inline void *lstate_toudata( lua_State *L, int idx, const char *tname )
+{
+    void *udata = lua_touserdata( L, idx );
+    
+    if( udata && lua_getmetatable( L, idx ) )
+    {
+        luaL_getmetatable( L, tname );
+        if( !lua_rawequal( L, -1, -2 ) ){
+            udata = NULL;
+        }
+        lua_pop( L, 2 );
+        return udata;
+    }
+    
+    return NULL;
+}
+
+
+// remove all fields of the table at idx
+static inline void lstate_tblclear( lua_State *L, int idx )
+{
+    // convert to absolute index
+    if( idx < 0 ){
+        idx = lua_gettop( L ) + idx + 1;
+    }
+    
+    lua_pushnil( L );
+    while( lua_next( L, idx ) ){
+        lua_pop( L, 1 );
+        // assigning nil to an existing field is allowed during traversal
+        lua_pushvalue( L, -1 );
+        lua_pushnil( L );
+        lua_rawset( L, idx );
+    }
+}
+
+
 // table read(traverse)
 #define LSTATE_TBLREAD_ERR  -1
 #define LSTATE_TBLREAD_DONE 0
@@ -237,12 +317,62 @@ static inline int lstate_tablelen( lua_State *L, size_t *len )
 }
 
 
-as_record *lstate_tbl2asrec( lua_State *L );
+/**
+ * returns the length of the table at the stack top if its keys are exactly
+ * 1..lua_objlen, otherwise 0.
+ * keys are only checked here, the values can be read by lua_rawgeti.
+ */
+static inline size_t lstate_seqlen( lua_State *L )
+{
+    size_t len = lua_objlen( L, -1 );
+    size_t nitem = 0;
+    lua_Number idx = 0;
+    
+    if( !len ){
+        return 0;
+    }
+    
+    // push space
+    lua_pushnil( L );
+    // key: -2, val: -1
+    while( lua_next( L, -2 ) )
+    {
+        lua_pop( L, 1 );
+        if( lua_type( L, -1 ) != LUA_TNUMBER ||
+            ( idx = lua_tonumber( L, -1 ) ) < 1 || idx > len ||
+            idx != (lua_Number)(size_t)idx ){
+            lua_pop( L, 1 );
+            return 0;
+        }
+        nitem++;
+    }
+    
+    // distinct keys of 1..len
+    return nitem == len ? len : 0;
+}
+
+// number of bins of the record that can be allocated on the stack
+#define LAS_RECORD_NBINS_STACK  64
+
+int lstate_tblnbins( lua_State *L, uint16_t *nbins );
 as_val *lstate_tbl2asval( lua_State *L );
 as_query *lstate_tbl2asqry( lua_State *L, const char *ns, const char *set );
 
 int lstate_asval2lua( lua_State *L, as_val *val );
-uint16_t lstate_asrec2tbl( lua_State *L, as_record *rec );
+int lstate_asrec2tbl( lua_State *L, as_record *rec );
+int lstate_asrec2tblat( lua_State *L, as_record *rec );
+int lstate_asrec2result( lua_State *L, as_record *rec );
+
+
+// push the result table that passed as a last argument or a new table
+#define lstate_pushinto( L, into, narr, nrec ) do { \
+    if( into ){ \
+        lua_pushvalue( L, into ); \
+    } \
+    else { \
+        lua_createtable( L, narr, nrec ); \
+    } \
+}while(0)
 
 
 
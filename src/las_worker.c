@@ -0,0 +1,94 @@
+/*
+ *  Copyright 2014 Masatoshi Teruya. All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  las_worker.c
+ *  lua-aerospike
+ *
+ *  Created by Masatoshi Teruya on 2014/09/15.
+ *
+ */
+
+#include <pthread.h>
+#include "las_worker.h"
+
+
+typedef struct {
+    las_worker_fn fn;
+    void *udata;
+    uint32_t ntask;
+    // index of next task
+    uint32_t next;
+    // index of next thread
+    uint32_t nslot;
+} las_worker_t;
+
+
+static void *worker( void *arg )
+{
+    las_worker_t *w = (las_worker_t*)arg;
+    uint32_t slot = __sync_fetch_and_add( &w->nslot, 1 );
+    uint32_t idx = 0;
+    
+    while( ( idx = __sync_fetch_and_add( &w->next, 1 ) ) < w->ntask ){
+        w->fn( idx, slot, w->udata );
+    }
+    
+    return NULL;
+}
+
+
+/**
+ * run the tasks 0...ntask-1 on nthread threads that includes the caller
+ * thread, and wait for them to finish.
+ * remaining tasks are run by the started threads if pthread_create failed.
+ */
+void las_worker_run( uint32_t ntask, uint32_t nthread, las_worker_fn fn,
+                     void *udata )
+{
+    las_worker_t w = {
+        .fn = fn,
+        .udata = udata,
+        .ntask = ntask,
+        .next = 0,
+        .nslot = 0
+    };
+    
+    nthread = las_worker_nthread( ntask, nthread );
+    if( nthread > 1 )
+    {
+        pthread_t tid[nthread - 1];
+        uint32_t nrun = 0;
+        
+        for(; nrun < nthread - 1; nrun++ ){
+            if( pthread_create( &tid[nrun], NULL, worker, (void*)&w ) != 0 ){
+                break;
+            }
+        }
+        worker( (void*)&w );
+        while( nrun ){
+            pthread_join( tid[--nrun], NULL );
+        }
+    }
+    else {
+        worker( (void*)&w );
+    }
+}
@@ -0,0 +1,53 @@
+/*
+ *  Copyright 2014 Masatoshi Teruya. All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  las_worker.h
+ *  lua-aerospike
+ *
+ *  Created by Masatoshi Teruya on 2014/09/15.
+ *
+ */
+
+#ifndef lua_aerospike_las_worker_h
+#define lua_aerospike_las_worker_h
+
+#include <stdint.h>
+
+// default and maximum number of threads
+#define LAS_WORKER_NTHREAD      4
+#define LAS_WORKER_NTHREAD_MAX  64
+
+// task callback; it must not touch the lua_State.
+// slot is the index of the thread that runs the task, 0...nthread-1, so the
+// tasks of the same slot never run concurrently.
+typedef void (*las_worker_fn)( uint32_t idx, uint32_t slot, void *udata );
+
+// number of threads that run ntask tasks
+#define las_worker_nthread( ntask, nthread ) \
+    ( (nthread) > (ntask) ? (ntask) : (nthread) )
+
+// prototypes
+void las_worker_run( uint32_t ntask, uint32_t nthread, las_worker_fn fn,
+                     void *udata );
+
+
+#endif
@@ -0,0 +1,32 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local batch, res, into;
+
+printUsage( 'aerospike.batch', CONTEXT, DATA.KEYS );
+batch = assert( aerospike.batch( CONTEXT, DATA.KEYS ) );
+print( '>>', batch, #batch );
+assert( #batch == #DATA.KEYS );
+
+-- can be executed repeatedly
+printUsage( 'batch:get' );
+res = assert( batch:get() );
+print( '>>', inspect( res ) );
+printUsage( 'batch:get', 'into' );
+into = assert( batch:get( res ) );
+assert( into == res );
+
+printUsage( 'batch:exists' );
+print( '>>', inspect(assert(
+    batch:exists()
+)));
+
+printUsage( 'batch:select', DATA.SELECT );
+print( '>>', inspect(assert(
+    batch:select( DATA.SELECT )
+)));
+
+-- invalid key
+printUsage( 'aerospike.batch', CONTEXT, { true } );
+print( '>>', assert( not aerospike.batch( CONTEXT, { true } ) ) );
@@ -0,0 +1,46 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local res, err, i;
+
+printUsage( 'context:batchApply', DATA.KEYS, DATA.APPLY.module, DATA.APPLY.func );
+res, err = CONTEXT:batchApply( DATA.KEYS, DATA.APPLY.module, DATA.APPLY.func,
+                               DATA.APPLY.args );
+print( '>>', inspect( res ), inspect( err ) );
+assert( res and not err );
+-- results in order of keys
+assert( #res == #DATA.KEYS );
+for i = 1, #res do
+    assert( res[i].val == CONTEXT:apply( DATA.KEYS[i], DATA.APPLY.module,
+                                         DATA.APPLY.func, DATA.APPLY.args ) );
+end
+
+-- errors of keys are placed in the results
+res, err = CONTEXT:batchApply( DATA.KEYS, DATA.APPLY.module, 'undefined_func' );
+print( '>>', inspect( res ), inspect( err ) );
+assert( res and not err );
+assert( res[1].val == nil and type( res[1].err ) == 'string' );
+
+-- error of the call
+printUsage( 'context:batchApply', { {} }, DATA.APPLY.module, DATA.APPLY.func );
+res, err = CONTEXT:batchApply( { {} }, DATA.APPLY.module, DATA.APPLY.func );
+print( '>>', inspect( res ), inspect( err ) );
+assert( res == nil and type( err ) == 'string' );
+
+-- arguments are sent by several threads at once
+local CONCURRENT = assert(
+    require('./connect'):context( DATA.NAMESPACE, DATA.SET, {
+        chunk = 2,
+        concurrency = 4
+    })
+);
+printUsage( 'context:batchApply', DATA.WKEYS, DATA.APPLY.module, DATA.APPLY.func );
+res, err = CONCURRENT:batchApply( DATA.WKEYS, DATA.APPLY.module,
+                                  DATA.APPLY.func, DATA.APPLY.args );
+print( '>>', inspect( res ), inspect( err ) );
+assert( res and not err );
+assert( #res == #DATA.WKEYS );
+for i = 1, #res do
+    assert( res[i].err == nil and res[i].val == res[1].val );
+end
@@ -0,0 +1,20 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local nrec = 0;
+
+printUsage( 'context:batchEach', DATA.KEYS, 'function' );
+assert( CONTEXT:batchEach( DATA.KEYS, function( pk, rec )
+    print( '>>', pk, inspect( rec ) );
+    nrec = nrec + 1;
+end));
+assert( nrec == #DATA.KEYS );
+
+-- stop by false
+nrec = 0;
+assert( CONTEXT:batchEach( DATA.KEYS, function()
+    nrec = nrec + 1;
+    return false;
+end));
+assert( nrec == 1 );
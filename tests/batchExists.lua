@@ -7,3 +7,24 @@ printUsage( 'context:batchExists', unpack( DATA.KEYS ) );
 print( '>>', inspect(assert(
     CONTEXT:batchExists( unpack( DATA.KEYS ) )
 )));
+
+-- bitmap that bit i is set if key i exists
+local BITMAP = assert(
+    require('./connect'):context( DATA.NAMESPACE, DATA.SET, { bitmap = true } )
+);
+local keys = { unpack( DATA.KEYS ) };
+keys[#keys+1] = 'missing-key';
+keys[#keys+1] = DATA.KEYS[1];
+printUsage( 'context:batchExists', keys );
+local bits = assert( BITMAP:batchExists( keys ) );
+local function isset( i )
+    local byte = bits:byte( math.floor( ( i - 1 ) / 8 ) + 1 );
+    return math.floor( byte / 2 ^ ( ( i - 1 ) % 8 ) ) % 2 == 1;
+end
+assert( #bits == math.ceil( #keys / 8 ) );
+for i = 1, #DATA.KEYS do
+    assert( isset( i ) );
+end
+assert( not isset( #keys - 1 ) );
+assert( isset( #keys ) );
+print( '>>', ('%q'):format( bits ) );
@@ -7,3 +7,69 @@ printUsage( 'context:batchGet', unpack( DATA.KEYS ) );
 print( '>>', inspect(assert(
     CONTEXT:batchGet( unpack( DATA.KEYS ) )
 )));
+
+-- refill the result table
+local into = {};
+local args = { unpack( DATA.KEYS ) };
+args[#args+1] = into;
+printUsage( 'context:batchGet', unpack( args ) );
+assert( CONTEXT:batchGet( unpack( args ) ) == into );
+local rec = into[DATA.KEYS[1]];
+assert( CONTEXT:batchGet( unpack( args ) ) == into );
+-- record tables are reused
+local reused = false;
+for _, v in pairs( into ) do
+    reused = reused or v == rec;
+end
+assert( reused );
+print( '>>', inspect( into ) );
+
+-- results in order of keys
+local ORDERED = assert(
+    require('./connect'):context( DATA.NAMESPACE, DATA.SET, { ordered = true } )
+);
+local keys = { unpack( DATA.KEYS ) };
+keys[#keys+1] = 'missing-key';
+printUsage( 'context:batchGet', unpack( keys ) );
+local res = assert( ORDERED:batchGet( unpack( keys ) ) );
+assert( #res == #keys );
+assert( res[#keys] == false );
+print( '>>', inspect( res ) );
+
+-- array of keys that split into the chunks
+local CHUNKED = assert(
+    require('./connect'):context( DATA.NAMESPACE, DATA.SET, {
+        ordered = true,
+        chunk = 2,
+        concurrency = 2
+    })
+);
+printUsage( 'context:batchGet', keys );
+res = assert( CHUNKED:batchGet( keys ) );
+assert( #res == #keys );
+assert( res[1].bins.a == DATA.DATA.a );
+assert( res[#keys] == false );
+print( '>>', inspect( res ) );
+
+-- duplicated keys are read once and placed at every position
+keys = { DATA.KEYS[1], DATA.KEYS[2], DATA.KEYS[1], 'missing-key', DATA.KEYS[1] };
+printUsage( 'context:batchGet', unpack( keys ) );
+res = assert( ORDERED:batchGet( unpack( keys ) ) );
+assert( #res == #keys );
+assert( res[1] == res[3] and res[1] == res[5] );
+assert( res[2].bins and res[4] == false );
+res = assert( ORDERED:batchGet( keys, res ) );
+assert( res[1] == res[3] and res[1] ~= res[2] );
+res = assert( CHUNKED:batchGet( keys ) );
+assert( #res == #keys );
+assert( res[1] == res[3] and res[4] == false );
+print( '>>', inspect( res ) );
+
+-- record tables of the previous results are reused without their bins
+res = assert( ORDERED:batchGet( DATA.KEYS ) );
+local rec = res[1];
+assert( next( rec.bins ) ~= nil );
+res = assert( ORDERED:batchGet( { 'missing-key' }, res ) );
+assert( #res == 1 and res[1] == false );
+assert( next( rec.bins ) == nil );
+print( '>>', inspect( res ) );
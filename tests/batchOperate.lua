@@ -0,0 +1,29 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local operation = require('./operation');
+local res, i;
+
+printUsage( 'context:batchOperate', operation, DATA.KEYS );
+res = assert( CONTEXT:batchOperate( operation, DATA.KEYS ) );
+print( '>>', inspect( res ) );
+-- results in order of keys
+for i = 1, #DATA.KEYS do
+    assert( type( res[i] ) == 'table' );
+end
+
+-- operations are sent by several threads at once
+local CONCURRENT = assert(
+    require('./connect'):context( DATA.NAMESPACE, DATA.SET, {
+        ordered = true,
+        chunk = 2,
+        concurrency = 4
+    })
+);
+printUsage( 'context:batchOperate', operation, DATA.WKEYS );
+res = assert( CONCURRENT:batchOperate( operation, DATA.WKEYS ) );
+print( '>>', inspect( res ) );
+for i = 1, #DATA.WKEYS do
+    assert( type( res[i] ) == 'table' );
+end
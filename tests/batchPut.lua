@@ -0,0 +1,22 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local records = {};
+local res, i;
+
+for i = 1, #DATA.WKEYS do
+    records[i] = { a = 'wkey', c = i };
+end
+
+printUsage( 'context:batchPut', DATA.WKEYS, records, DATA.TTL );
+res = assert( CONTEXT:batchPut( DATA.WKEYS, records, DATA.TTL ) );
+print( '>>', inspect( res ) );
+-- status in order of keys
+assert( #res == #DATA.WKEYS );
+for i = 1, #res do
+    assert( res[i] == true );
+end
+
+-- number of records must be equal to number of keys
+assert( not pcall( CONTEXT.batchPut, CONTEXT, DATA.WKEYS, { records[1] } ) );
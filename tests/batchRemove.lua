@@ -0,0 +1,18 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local res, i;
+
+printUsage( 'context:batchRemove', DATA.WKEYS );
+res = assert( CONTEXT:batchRemove( DATA.WKEYS ) );
+print( '>>', inspect( res ) );
+for i = 1, #DATA.WKEYS do
+    assert( res[i] == true );
+end
+
+-- already removed
+res = assert( CONTEXT:batchRemove( DATA.WKEYS ) );
+for i = 1, #DATA.WKEYS do
+    assert( res[i] == false );
+end
@@ -0,0 +1,9 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+
+printUsage( 'context:batchSelect', DATA.SELECT, unpack( DATA.KEYS ) );
+print( '>>', inspect(assert(
+    CONTEXT:batchSelect( DATA.SELECT, unpack( DATA.KEYS ) )
+)));
@@ -0,0 +1,11 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local keys = { DATA.WKEYS[1], 'test-wkey-notfound' };
+local res;
+
+printUsage( 'context:batchTouch', keys );
+res = assert( CONTEXT:batchTouch( keys ) );
+print( '>>', inspect( res ) );
+assert( res[1] == true and res[2] == false );
@@ -3,6 +3,10 @@ local i;
 for i = 1, 3 do
     keys[#keys+1] = 'test-key' .. i;
 end
+local wkeys = {};
+for i = 1, 10 do
+    wkeys[#wkeys+1] = 'test-wkey' .. i;
+end
 
 local UDF_TMPL = [[
 
@@ -31,6 +35,10 @@ return {
         'help', 'features', 'namespaces', 'sets'
     },
     KEYS = keys,
+    WKEYS = wkeys,
+    DIGEST = ('0'):rep( 40 ),
+    INTKEY = 1234567890,
+    BINKEY = 'bin\0key',
     TTL = -1,
     SELECT = { 'a', 'b', 'list' },
     IDX_STR = {
@@ -11,3 +11,12 @@ for _, v in ipairs( DATA.KEYS ) do
     )));
 end
 
+
+-- refill the result table
+local into = {};
+for _, v in ipairs( DATA.KEYS ) do
+    printUsage( 'context:get', v, into );
+    assert( CONTEXT:get( v, into ) == into );
+    assert( into.bins.a == DATA.DATA.a );
+    print( '>>', inspect( into ) );
+end
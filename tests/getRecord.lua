@@ -0,0 +1,46 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local _, v, rec;
+
+for _, v in ipairs( DATA.KEYS ) do
+    printUsage( 'context:getRecord', v );
+    rec = assert( CONTEXT:getRecord( v ) );
+    assert( rec.pk == v );
+    assert( rec.a == DATA.DATA.a );
+    -- converted value is cached
+    assert( rec.map == rec.map );
+    assert( rec.nbins > 0 );
+    print( '>>', rec.ttl, rec.gen, rec.nbins, inspect( rec.bins ) );
+    assert( rec.bins.map == rec.map );
+    
+    printUsage( 'context:getRecord', v, unpack( DATA.SELECT ) );
+    rec = assert( CONTEXT:getRecord( v, unpack( DATA.SELECT ) ) );
+    assert( rec.a == DATA.DATA.a );
+    print( '>>', rec.ttl, rec.gen, rec.nbins, inspect( rec.bins ) );
+end
+
+-- more bin names than the array on the stack can hold
+local names = { unpack( DATA.SELECT ) };
+for _ = 1, 32 do
+    names[#names + 1] = 'nobin' .. _;
+end
+printUsage( 'context:getRecord', DATA.KEYS[1], unpack( names ) );
+rec = assert( CONTEXT:getRecord( DATA.KEYS[1], unpack( names ) ) );
+assert( rec.a == DATA.DATA.a );
+assert( rec:bin('nobin1') == nil );
+
+-- bins that named same as the metadata fields
+local key = DATA.WKEYS[1];
+local bins = { ttl = 'bin-ttl', pk = 'bin-pk', bin = 'bin-bin' };
+
+assert( CONTEXT:put( key, bins, DATA.TTL ) );
+printUsage( 'context:getRecord', aerospike.key( CONTEXT, key ) );
+rec = assert( CONTEXT:getRecord( aerospike.key( CONTEXT, key ) ) );
+assert( rec.pk == key );
+assert( type( rec.ttl ) == 'number' );
+assert( rec:bin('ttl') == bins.ttl );
+assert( rec:bin('pk') == bins.pk );
+assert( rec:bin('bin') == bins.bin );
+assert( CONTEXT:remove( key ) );
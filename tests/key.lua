@@ -0,0 +1,82 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local _, v, key;
+
+for _, v in ipairs( DATA.KEYS ) do
+    printUsage( 'aerospike.key', CONTEXT, v );
+    key = assert( aerospike.key( CONTEXT, v ) );
+    print( '>>', key );
+    
+    printUsage( 'context:get', key );
+    print( '>>', inspect(assert(
+        CONTEXT:get( key )
+    )));
+end
+
+printUsage( 'aerospike.key', CONTEXT, DATA.DIGEST, aerospike.KEY_DIGEST );
+key = assert( aerospike.key( CONTEXT, DATA.DIGEST, aerospike.KEY_DIGEST ) );
+print( '>>', key );
+
+printUsage( 'context:exists', key );
+print( '>>', CONTEXT:exists( key ) );
+
+printUsage( 'context:put', DATA.INTKEY, DATA.DATA, DATA.TTL );
+print( '>>', assert(
+    CONTEXT:put( DATA.INTKEY, DATA.DATA, DATA.TTL )
+));
+
+printUsage( 'aerospike.key', CONTEXT, DATA.INTKEY );
+key = assert( aerospike.key( CONTEXT, DATA.INTKEY ) );
+print( '>>', key );
+
+printUsage( 'context:get', key );
+print( '>>', inspect(assert(
+    CONTEXT:get( key )
+)));
+
+printUsage( 'context:remove', DATA.INTKEY );
+print( '>>', assert(
+    CONTEXT:remove( DATA.INTKEY )
+));
+
+printUsage( 'aerospike.key', CONTEXT, DATA.BINKEY, aerospike.KEY_BYTES );
+key = assert( aerospike.key( CONTEXT, DATA.BINKEY, aerospike.KEY_BYTES ) );
+print( '>>', key );
+
+printUsage( 'context:put', key, DATA.DATA, DATA.TTL );
+print( '>>', assert(
+    CONTEXT:put( key, DATA.DATA, DATA.TTL )
+));
+
+printUsage( 'context:remove', key );
+print( '>>', assert(
+    CONTEXT:remove( key )
+));
+
+
+-- non-integral number key
+printUsage( 'aerospike.key', CONTEXT, 1.5 );
+assert( not pcall( aerospike.key, CONTEXT, 1.5 ) );
+printUsage( 'context:get', 1.5 );
+assert( not pcall( CONTEXT.get, CONTEXT, 1.5 ) );
+
+-- NaN and out of range number key
+local _, num;
+for _, num in ipairs({ 0/0, 2^63, -2^63 * 2, 1/0 }) do
+    printUsage( 'aerospike.key', CONTEXT, tostring( num ) );
+    assert( not pcall( aerospike.key, CONTEXT, num ) );
+    printUsage( 'context:get', tostring( num ) );
+    assert( not pcall( CONTEXT.get, CONTEXT, num ) );
+end
+
+-- prepared key of other set
+local OTHER = assert(
+    require('./connect'):context( DATA.NAMESPACE, DATA.SET .. '-other' )
+);
+key = assert( aerospike.key( OTHER, DATA.KEYS[1] ) );
+printUsage( 'context:get', key );
+assert( not pcall( CONTEXT.get, CONTEXT, key ) );
+printUsage( 'context:batchGet', { key } );
+assert( not CONTEXT:batchGet( { key } ) );
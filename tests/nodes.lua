@@ -0,0 +1,11 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local nodes;
+
+printUsage( 'context:nodes' );
+nodes = CONTEXT:nodes();
+print( '>>', inspect( nodes ) );
+assert( #nodes > 0 );
+
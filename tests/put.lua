@@ -12,3 +12,43 @@ for _, v in ipairs( DATA.KEYS ) do
     ));
 end
 
+
+-- sequence stored in the hash part keeps its order
+local seq = {};
+local key = DATA.WKEYS[1];
+local res;
+
+for _, v in ipairs({ 3, 1, 2 }) do
+    seq[v] = 'v' .. v;
+end
+printUsage( 'context:put', key, { list = seq }, DATA.TTL );
+assert( CONTEXT:put( key, { list = seq }, DATA.TTL ) );
+res = assert( CONTEXT:get( key ) );
+assert( res.bins.list[1] == 'v1' and res.bins.list[2] == 'v2' and
+        res.bins.list[3] == 'v3' );
+assert( CONTEXT:remove( key ) );
+
+-- sparse array and mixed table
+printUsage( 'context:put', key, { list = { [1] = 'a', [3] = 'c' } }, DATA.TTL );
+assert( not CONTEXT:put( key, { list = { [1] = 'a', [3] = 'c' } }, DATA.TTL ) );
+printUsage( 'context:put', key, { list = { 'a', x = 'x' } }, DATA.TTL );
+assert( not CONTEXT:put( key, { list = { 'a', x = 'x' } }, DATA.TTL ) );
+
+-- nested empty table is not stored; a trailing one is dropped from the list
+local bins = {
+    map = { x = 'x', empty = {} },
+    list = { 'a', {}, 'c', {} }
+};
+printUsage( 'context:put', key, bins, DATA.TTL );
+assert( CONTEXT:put( key, bins, DATA.TTL ) );
+res = assert( CONTEXT:get( key ) );
+assert( res.bins.map.x == 'x' and res.bins.map.empty == nil );
+assert( res.bins.list[1] == 'a' and res.bins.list[2] == nil and
+        res.bins.list[3] == 'c' and res.bins.list[4] == nil );
+assert( CONTEXT:remove( key ) );
+
+-- nested sparse array and mixed table
+printUsage( 'context:put', key, { map = { list = { [1] = 'a', [3] = 'c' } } }, DATA.TTL );
+assert( not CONTEXT:put( key, { map = { list = { [1] = 'a', [3] = 'c' } } }, DATA.TTL ) );
+printUsage( 'context:put', key, { list = { { 'a', x = 'x' } } }, DATA.TTL );
+assert( not CONTEXT:put( key, { list = { { 'a', x = 'x' } } }, DATA.TTL ) );
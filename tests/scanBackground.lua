@@ -2,9 +2,20 @@ require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
 require('./helper');
 
 local CONTEXT = require('./context');
+local job, status;
 
-printUsage( 'context:scanBackground' );
-print( '>>', inspect(assert(
-    CONTEXT:scanBackground( DATA.SCAN_OPT )
-)));
+printUsage( 'context:scanBackground', DATA.SCAN_OPT );
+job = assert( CONTEXT:scanBackground( DATA.SCAN_OPT ) );
+print( '>> id', job:id() );
+status = assert( job:status() );
+print( '>>', inspect( status ) );
+assert( type( status.progress ) == 'number' );
+assert( job:wait( 60000 ) == true );
+assert( job:status().status == aerospike.SCAN_STATUS_COMPLETED );
+
+-- abort
+job = assert( CONTEXT:scanBackground( DATA.SCAN_OPT ) );
+print( '>> abort', job:abort() );
+assert( job:wait( 60000 ) ~= nil );
+assert( not pcall( job.wait, job, -1 ) );
 
@@ -8,3 +8,11 @@ print( '>>', inspect(assert(
     CONTEXT:scanEach( DATA.SCAN_OPT, unpack( DATA.SELECT ) )
 )));
 
+
+-- concurrent node scans
+local opt = { concurrent = true };
+local res;
+
+printUsage( 'context:scanEach', opt, unpack( DATA.SELECT ) );
+res = assert( CONTEXT:scanEach( opt, unpack( DATA.SELECT ) ) );
+print( '>> nrec', #res );
@@ -0,0 +1,26 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local nrec = 0;
+
+printUsage( 'context:scanForEach', DATA.SCAN_OPT, 'function', unpack( DATA.SELECT ) );
+assert( CONTEXT:scanForEach( DATA.SCAN_OPT, function( rec )
+    print( '>>', inspect( rec ) );
+    nrec = nrec + 1;
+end, unpack( DATA.SELECT ) ) );
+print( '>> nrec', nrec );
+
+-- stop by false
+nrec = 0;
+assert( CONTEXT:scanForEach( nil, function()
+    nrec = nrec + 1;
+    return false;
+end));
+assert( nrec == 1 );
+
+-- error from fn
+assert( not CONTEXT:scanForEach( nil, function()
+    error( 'stop' );
+end));
+
@@ -0,0 +1,24 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local iter, nrec;
+
+printUsage( 'context:scanIter', DATA.SCAN_OPT, unpack( DATA.SELECT ) );
+iter = assert( CONTEXT:scanIter( DATA.SCAN_OPT, unpack( DATA.SELECT ) ) );
+nrec = 0;
+for rec in iter do
+    nrec = nrec + 1;
+    print( '>>', inspect( rec ) );
+end
+print( '>> nrec', nrec );
+assert( iter:error() == nil );
+iter:close();
+
+-- close before drained
+printUsage( 'context:scanIter', { buffer = 1 } );
+iter = assert( CONTEXT:scanIter( { buffer = 1 } ) );
+iter();
+iter:close();
+assert( iter() == nil );
+
@@ -0,0 +1,23 @@
+require('process').chdir( (arg[0]):match( '^(.+[/])[^/]+%.lua$' ) );
+require('./helper');
+
+local CONTEXT = require('./context');
+local nrec = 0;
+local res, node, _, rec;
+
+for _, node in ipairs( CONTEXT:nodes() ) do
+    printUsage( 'context:scanNode', DATA.SCAN_OPT, node, unpack( DATA.SELECT ) );
+    res = assert( CONTEXT:scanNode( DATA.SCAN_OPT, node, unpack( DATA.SELECT ) ) );
+    for _, rec in ipairs( res ) do
+        assert( rec.node == node );
+        assert( rec.partition >= 0 and rec.partition < 4096 );
+    end
+    print( '>> nrec', node, #res );
+    nrec = nrec + #res;
+end
+print( '>> total', nrec );
+
+-- invalid node name
+assert( not pcall( CONTEXT.scanNode, CONTEXT, nil, '' ) );
+assert( not CONTEXT:scanNode( nil, 'unknown-node' ) );
+
@@ -11,3 +11,16 @@ for _, v in ipairs( DATA.KEYS ) do
     )));
 end
 
+
+-- more bin names than the array on the stack can hold
+local bins = { unpack( DATA.SELECT ) };
+local res;
+for _ = 1, 32 do
+    bins[#bins + 1] = 'nobin' .. _;
+end
+printUsage( 'context:select', DATA.KEYS[1], unpack( bins ) );
+res = assert( CONTEXT:select( DATA.KEYS[1], unpack( bins ) ) );
+for _, v in ipairs( DATA.SELECT ) do
+    assert( res.bins[v] ~= nil );
+end
+assert( res.bins.nobin1 == nil );
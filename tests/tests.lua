@@ -33,15 +33,29 @@ local TESTS = {
     'indexCreate',
     'put',
     'get',
+    'key',
     'select',
+    'getRecord',
     'exists',
     'operation',
     'operate',
     'batchGet',
+    'batchSelect',
     'batchExists',
+    'batchEach',
+    'batch',
+    'batchPut',
+    'batchTouch',
+    'batchOperate',
+    'batchRemove',
     'scanEach',
+    'scanIter',
+    'scanForEach',
+    'nodes',
+    'scanNode',
     'scanBackground',
     'apply',
+    'batchApply',
     'query',
     'remove',
     'info',